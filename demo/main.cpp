@@ -32,7 +32,10 @@ int main() {
     mpu6050 mpu(bus);
 
     // Correct the gyro of the sensor slightly
-    ipass::gyro_corrected_motion_sensor sensor(mpu, {-6, -1, 0});
+    const ipass::vector3<int16_t> gyro_offset = {
+        ipass::gyro_format::from_int(-6), ipass::gyro_format::from_int(-1), 0
+    };
+    ipass::gyro_corrected_motion_sensor sensor(mpu, gyro_offset);
 
     /*
      * Optionally, the cached_motion_sensor decorator can be
@@ -43,13 +46,24 @@ int main() {
     // Initialize the hardware
     sensor.initialize();
 
-    // Building block rules
-    ipass::gyro_rule hand_tilted_backwards_y = {ipass::motion::y_less_then, -150};
-    ipass::gyro_rule hand_tilted_forwards_y = {ipass::motion::y_greater_then, 150};
-    ipass::accel_rule hand_flat = {ipass::motion::z_equal_to, 1};
+    /*
+     * Optionally, with the INT pin of the sensor connected,
+     * the handlers can be processed only when there is new
+     * data, leaving the bus idle in between. Use INTERRUPT_MOTION
+     * and set_motion_detection() to only wake on motion, and
+     * call sensor.process_handlers() without a sample.
+     */
+    // auto interrupt = hwlib::target::pin_in(hwlib::target::pins::d2);
+    // mpu.enable_interrupts(mpu6050::INTERRUPT_DATA_READY);
+    // sensor.use_interrupt(&interrupt);
+
+    // Building block rules, in degrees per second and g
+    ipass::gyro_rule hand_tilted_backwards_y = {ipass::motion::y_less_then, ipass::gyro_format::from_int(-150)};
+    ipass::gyro_rule hand_tilted_forwards_y = {ipass::motion::y_greater_then, ipass::gyro_format::from_int(150)};
+    ipass::accel_rule hand_flat = {ipass::motion::z_greater_then, ipass::accel_format::from_ratio(9, 10)};
 
-    ipass::gyro_rule hand_tilted_left = {ipass::motion::x_less_then, -120};
-    ipass::gyro_rule hand_tilted_right = {ipass::motion::x_greater_then, 120};
+    ipass::gyro_rule hand_tilted_left = {ipass::motion::x_less_then, ipass::gyro_format::from_int(-120)};
+    ipass::gyro_rule hand_tilted_right = {ipass::motion::x_greater_then, ipass::gyro_format::from_int(120)};
 
     // Invert the hand flat rule
     auto hand_not_flat = ipass::inverted_motion_rule(hand_flat);
@@ -59,22 +73,29 @@ int main() {
     auto hand_tilted_forwards = hand_tilted_forwards_y + hand_not_flat;
 
     // Register a handler for the motion rule
-    sensor.when(hand_tilted_backwards, [](const auto &, const auto &) {
+    const auto backwards = sensor.when(hand_tilted_backwards, [](const auto &, const auto &) {
         hwlib::cout << "Hand tilted backwards" << hwlib::endl;
     });
 
-    sensor.when(hand_tilted_forwards, [](const auto &, const auto &) {
+    const auto forwards = sensor.when(hand_tilted_forwards, [](const auto &, const auto &) {
         hwlib::cout << "Hand tilted forwards" << hwlib::endl;
     });
 
-    sensor.when(hand_tilted_left, [](const auto &, const auto &) {
+    const auto left = sensor.when(hand_tilted_left, [](const auto &, const auto &) {
         hwlib::cout << "Hand tilted left" << hwlib::endl;
     });
 
-    sensor.when(hand_tilted_right, [](const auto &, const auto &) {
+    const auto right = sensor.when(hand_tilted_right, [](const auto &, const auto &) {
         hwlib::cout << "Hand tilted right" << hwlib::endl;
     });
 
+    // Writing to the console is slow, so report
+    // every motion at most twice per second
+    sensor.set_refractory(backwards, 500000);
+    sensor.set_refractory(forwards, 500000);
+    sensor.set_refractory(left, 500000);
+    sensor.set_refractory(right, 500000);
+
     uint_fast64_t start = 0;
 
     for (;;) {
@@ -82,33 +103,32 @@ int main() {
 
         display.clear(hwlib::buffering::buffered);
 
+        // Read the sensor once, and use the
+        // same data for the rules and the display
+        const auto sample = sensor.get_sample();
+        const auto &accel = sample.accel;
+        const auto &gyro = sample.gyro;
+
         // Run checks for all rules
-        sensor.process_handlers();
-
-        // Get data to display
-        // @note: this is not the most efficient,
-        // since this will fetch data from the chip again.
-        // The data will be recent, but it will be slower than caching.
-        const auto accel = sensor.get_accel();
-        const auto gyro = sensor.get_gyro();
-
-        // Display the accel and gyro info
-        // on the oled display
-        display << "A x:" << accel.x
-                << ",y:" << accel.y
-                << ",z:" << accel.z
+        sensor.process_handlers(sample);
+
+        // Display the accel info in mg and the gyro
+        // info in degrees per second on the oled display
+        display << "A x:" << ipass::accel_format::to_milli(accel.x)
+                << ",y:" << ipass::accel_format::to_milli(accel.y)
+                << ",z:" << ipass::accel_format::to_milli(accel.z)
                 << "\n\n";
 
-        display << "G x:" << gyro.x
-                << "\n\ty:" << gyro.y
-                << "\n\tz:" << gyro.z
+        display << "G x:" << ipass::gyro_format::to_int(gyro.x)
+                << "\n\ty:" << ipass::gyro_format::to_int(gyro.y)
+                << "\n\tz:" << ipass::gyro_format::to_int(gyro.z)
                 << '\n';
 
         display << "ms: " << ((hwlib::now_us() - start) / 1000);
 
         display.flush();
 
-        // Also display on the console on the pc
+        // Also display the fixed point values on the console on the pc
         hwlib::cout << "G: " << gyro << "\nA: " << accel << hwlib::endl;
     }
 
@@ -9,22 +9,54 @@
 
 #include "mpu6050.hpp"
 
-mpu6050::mpu6050(hwlib::i2c_bus &bus, uint8_t address)
-        : bus(bus), address(address) {}
+mpu6050::mpu6050(hwlib::i2c_bus &bus, uint8_t address, const mpu6050_config &config)
+        : motion_sensor(handlers), handlers(), bus(bus), address(address), config(config),
+          gyro_multiplier(config.get_gyro_multiplier()), accel_shift(config.get_accel_shift()) {}
+
+mpu6050::mpu6050(hwlib::i2c_bus &bus, const mpu6050_config &config)
+        : mpu6050(bus, 0x68, config) {}
 
 void mpu6050::initialize() {
     uint8_t pwr[] = {PWR_MGMT_1, (uint8_t) 0};
     bus.write(address, pwr, 2);
 
-    // gyro_config and accel_config addresses
-    // are 1 apart, so we can write to both configs
-    // in one write
-    uint8_t config[] = {
-        GYRO_CONFIG, uint8_t(0),
-        ACCEL_CONFIG, uint8_t(0)
+    // smplrt_div, config, gyro_config and accel_config
+    // are adjacent and the register pointer increments
+    // after every byte, so one write sets all four
+    uint8_t registers[] = {
+        SMPLRT_DIV,
+        config.sample_divider,
+        uint8_t(config.dlpf),
+        uint8_t(uint8_t(config.gyro_range) << 3),
+        uint8_t(uint8_t(config.accel_range) << 3)
+    };
+
+    bus.write(address, registers, 5);
+}
+
+ipass::vector3<int16_t> mpu6050::decode(const uint8_t *data) {
+    return {
+        int16_t(((data[0] << 8) | data[1])), // x
+        int16_t(((data[2] << 8) | data[3])), // y
+        int16_t(((data[4] << 8) | data[5]))  // z
     };
+}
 
-    bus.write(address, config, 4);
+ipass::motion_sample mpu6050::decode_sample(const uint8_t *accel, const uint8_t *gyro,
+                                            int16_t temperature, uint_fast64_t timestamp) {
+    return {scale_gyro(decode(gyro)), scale_accel(decode(accel)), temperature, timestamp};
+}
+
+ipass::vector3<int16_t> mpu6050::scale_accel(const ipass::vector3<int16_t> &raw) const {
+    return raw >> accel_shift;
+}
+
+ipass::vector3<int16_t> mpu6050::scale_gyro(const ipass::vector3<int16_t> &raw) const {
+    return {
+        ipass::gyro_format::from_raw(raw.x, gyro_multiplier, GYRO_SHIFT),
+        ipass::gyro_format::from_raw(raw.y, gyro_multiplier, GYRO_SHIFT),
+        ipass::gyro_format::from_raw(raw.z, gyro_multiplier, GYRO_SHIFT)
+    };
 }
 
 ipass::vector3<int16_t> mpu6050::get_sensor_data(const uint8_t start) {
@@ -33,22 +65,174 @@ ipass::vector3<int16_t> mpu6050::get_sensor_data(const uint8_t start) {
     bus.write(address, data, 1);
     bus.read(address, data, 6);
 
-    return {
-        int16_t(((data[0] << 8) | data[1])), // x
-        int16_t(((data[2] << 8) | data[3])), // y
-        int16_t(((data[4] << 8) | data[5]))  // z
-    };
+    return decode(data);
 }
 
 ipass::vector3<int16_t> mpu6050::get_accel() {
-    auto accel = get_sensor_data(ACCEL_XOUT_H);
-    accel /= 16384;
-    return accel;
+    return scale_accel(get_sensor_data(ACCEL_XOUT_H));
 }
 
 ipass::vector3<int16_t> mpu6050::get_gyro() {
-    auto gyro = get_sensor_data(GYRO_XOUT_H);
-    gyro /= 131.0;
-    return gyro;
+    return scale_gyro(get_sensor_data(GYRO_XOUT_H));
+}
+
+ipass::motion_sample mpu6050::get_sample() {
+    // 6 bytes accel, 2 bytes temperature and 6 bytes gyro
+    uint8_t data[SAMPLE_SIZE] = {ACCEL_XOUT_H};
+
+    bus.write(address, data, 1);
+    bus.read(address, data, SAMPLE_SIZE);
+
+    const auto temperature = int16_t((data[6] << 8) | data[7]);
+
+    return decode_sample(data, data + 8, temperature, get_timestamp());
+}
+
+void mpu6050::reset_fifo() {
+    // The FIFO is only reset while it is disabled
+    uint8_t reset[] = {USER_CTRL, USER_FIFO_RESET};
+    bus.write(address, reset, 2);
+
+    uint8_t control[] = {USER_CTRL, USER_FIFO_EN};
+    bus.write(address, control, 2);
+
+    fifo_started = false;
+}
+
+void mpu6050::start_fifo() {
+    uint8_t sources[] = {FIFO_EN, FIFO_SOURCES};
+    bus.write(address, sources, 2);
+
+    fifo_interval = config.get_sample_interval();
+    fifo_enabled = true;
+
+    reset_fifo();
+}
+
+void mpu6050::stop_fifo() {
+    uint8_t sources[] = {FIFO_EN, uint8_t(0)};
+    bus.write(address, sources, 2);
+
+    uint8_t control[] = {USER_CTRL, uint8_t(0)};
+    bus.write(address, control, 2);
+
+    fifo_enabled = false;
+}
+
+uint8_t mpu6050::read_status() {
+    uint8_t status[] = {INT_STATUS};
+    bus.write(address, status, 1);
+    bus.read(address, status, 1);
+
+    // Reading clears the status and the interrupt line, so keep what was not handled yet
+    const uint8_t result = status[0] | pending_status;
+    pending_status = 0;
+
+    return result;
+}
+
+void mpu6050::set_motion_detection(const uint8_t threshold, const uint8_t duration) {
+    uint8_t filter[] = {ACCEL_CONFIG, uint8_t((uint8_t(config.accel_range) << 3) | ACCEL_HPF_5HZ)};
+    bus.write(address, filter, 2);
+
+    uint8_t motion[] = {MOT_THR, threshold, duration};
+    bus.write(address, motion, 3);
+}
+
+void mpu6050::enable_interrupts(const uint8_t sources) {
+    uint8_t registers[] = {INT_PIN_CFG, LATCH_INT_EN, sources};
+    bus.write(address, registers, 3);
+
+    interrupts = sources;
+}
+
+bool mpu6050::acknowledge_interrupt() {
+    const uint8_t status = read_status();
+
+    // A FIFO overflow is handled by the next read_fifo()
+    pending_status = status & FIFO_OFLOW_INT;
+
+    return (status & interrupts) != 0;
+}
+
+bool mpu6050::has_pending_interrupt() {
+    return (pending_status & interrupts) != 0;
+}
+
+uint16_t mpu6050::read_fifo(ipass::motion_sample *samples, const uint16_t capacity) {
+    const uint8_t status = read_status();
+
+    // Motion or new data is still reported by acknowledge_interrupt()
+    pending_status = status & interrupts;
+
+    if (status & FIFO_OFLOW_INT) {
+        // The oldest bytes were overwritten, so the frames are no longer aligned
+        overflows++;
+        reset_fifo();
+        return 0;
+    }
+
+    uint8_t count[] = {FIFO_COUNTH, 0};
+    bus.write(address, count, 1);
+    bus.read(address, count, 2);
+
+    uint16_t frames = uint16_t(((count[0] << 8) | count[1]) / FRAME_SIZE);
+
+    if (frames > capacity) {
+        frames = capacity;
+    }
+
+    if (frames == 0) {
+        return 0;
+    }
+
+    // The newest sample was taken about now, but never before the end of the previous batch
+    const uint_fast64_t now = get_timestamp();
+    const uint_fast64_t span = uint_fast64_t(frames - 1) * fifo_interval;
+
+    uint_fast64_t timestamp = now > span ? now - span : 0;
+
+    if (fifo_started && timestamp < fifo_next) {
+        timestamp = fifo_next;
+    }
+
+    uint8_t data[FRAME_SIZE * FRAMES_PER_READ];
+
+    for (uint16_t done = 0; done < frames;) {
+        const uint16_t batch = frames - done < FRAMES_PER_READ ? uint16_t(frames - done) : FRAMES_PER_READ;
+
+        data[0] = FIFO_R_W;
+        bus.write(address, data, 1);
+        bus.read(address, data, batch * FRAME_SIZE);
+
+        for (uint16_t i = 0; i < batch; i++) {
+            const uint8_t *frame = data + i * FRAME_SIZE;
+
+            samples[done + i] = decode_sample(frame, frame + 6, 0, timestamp);
+            timestamp += fifo_interval;
+        }
+
+        done += batch;
+    }
+
+    fifo_next = timestamp;
+    fifo_started = true;
+
+    return frames;
+}
+
+uint16_t mpu6050::read_samples(ipass::motion_sample *samples, const uint16_t capacity) {
+    if (!fifo_enabled) {
+        return motion_sensor::read_samples(samples, capacity);
+    }
+
+    return read_fifo(samples, capacity);
 }
 
+uint32_t mpu6050::get_overflows() const {
+    return overflows;
+}
+
+const mpu6050_config &mpu6050::get_config() const {
+    return config;
+}
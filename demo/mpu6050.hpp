@@ -14,26 +14,345 @@
 #include "../library/vector3.hpp"
 #include "../library/motion_sensor.hpp"
 
+/**
+ * \brief
+ * Full scale range of the gyroscope, in degrees per second.
+ */
+enum class mpu6050_gyro_range : uint8_t {
+    dps_250,
+    dps_500,
+    dps_1000,
+    dps_2000
+};
+
+/**
+ * \brief
+ * Full scale range of the accelerometer, in g.
+ */
+enum class mpu6050_accel_range : uint8_t {
+    g_2,
+    g_4,
+    g_8,
+    g_16
+};
+
+/**
+ * \brief
+ * Bandwidth of the digital low pass filter of the accelerometer.
+ * \details
+ * The gyroscope bandwidth is about the same. Without the filter
+ * (hz_260) the gyroscope output rate is 8 kHz, otherwise 1 kHz.
+ */
+enum class mpu6050_dlpf : uint8_t {
+    hz_260,
+    hz_184,
+    hz_94,
+    hz_44,
+    hz_21,
+    hz_10,
+    hz_5
+};
+
+/**
+ * \brief
+ * Configuration of the mpu6050, applied by mpu6050::initialize().
+ * \details
+ * The scale factors follow from the ranges, and are constant
+ * expressions for a constexpr configuration. The sensor computes
+ * them once on construction, so the raw counts are converted to
+ * ipass::accel_format and ipass::gyro_format with a shift and an
+ * integer multiply, without any division.
+ *
+ * \code
+ * constexpr mpu6050_config config = {
+ *     mpu6050_gyro_range::dps_500, mpu6050_accel_range::g_4, mpu6050_dlpf::hz_44, 4
+ * };
+ *
+ * static_assert(config.get_sample_interval() == 5000, "200 Hz");
+ * mpu6050 sensor(bus, config);
+ * \endcode
+ */
+struct mpu6050_config {
+    mpu6050_gyro_range gyro_range = mpu6050_gyro_range::dps_250;
+    mpu6050_accel_range accel_range = mpu6050_accel_range::g_2;
+    mpu6050_dlpf dlpf = mpu6050_dlpf::hz_260;
+
+    /**
+     * \brief
+     * The sample rate is the gyroscope output rate divided by 1 + sample_divider.
+     */
+    uint8_t sample_divider = 0;
+
+    /**
+     * \brief
+     * The raw accelerometer value of 1 g.
+     * @return
+     */
+    constexpr int32_t get_accel_scale() const {
+        return int32_t(16384) >> uint8_t(accel_range);
+    }
+
+    /**
+     * \brief
+     * Ten times the raw gyroscope value of 1 degree per second.
+     * \details
+     * The sensitivity is 131, 65.5, 32.8 or 16.4 per degree per second,
+     * so it is kept in tenths to stay an integer.
+     * @return
+     */
+    constexpr int32_t get_gyro_scale() const {
+        return gyro_range == mpu6050_gyro_range::dps_250 ? 1310
+               : gyro_range == mpu6050_gyro_range::dps_500 ? 655
+               : gyro_range == mpu6050_gyro_range::dps_1000 ? 328
+               : 164;
+    }
+
+    /**
+     * \brief
+     * The right shift from raw accelerometer counts to ipass::accel_format.
+     * \details
+     * 1 g is a power of 2 in every range, so a shift is exact.
+     * @return
+     */
+    constexpr uint8_t get_accel_shift() const {
+        return uint8_t(14 - uint8_t(accel_range) - ipass::accel_format::fraction);
+    }
+
+    /**
+     * \brief
+     * The multiplier from raw gyroscope counts to ipass::gyro_format.
+     * \details
+     * The converted value is (raw * multiplier) >> 16.
+     * @return
+     */
+    constexpr int32_t get_gyro_multiplier() const {
+        return (ipass::gyro_format::one * 10 * 65536 * 2 + get_gyro_scale()) / (get_gyro_scale() * 2);
+    }
+
+    /**
+     * \brief
+     * The time between samples, in microseconds.
+     * @return
+     */
+    constexpr uint32_t get_sample_interval() const {
+        return (dlpf == mpu6050_dlpf::hz_260 ? 125 : 1000) * (uint32_t(sample_divider) + 1);
+    }
+};
+
 class mpu6050 : public ipass::motion_sensor {
 private:
+    static constexpr uint8_t CONFIG = 0x1A;
     static constexpr uint8_t GYRO_CONFIG = 0x1B;
     static constexpr uint8_t ACCEL_CONFIG = 0x1C;
     static constexpr uint8_t ACCEL_XOUT_H = 0x3B;
     static constexpr uint8_t GYRO_XOUT_H = 0x43;
     static constexpr uint8_t PWR_MGMT_1 = 0x6B;
+    static constexpr uint8_t SMPLRT_DIV = 0x19;
+    static constexpr uint8_t FIFO_EN = 0x23;
+    static constexpr uint8_t INT_STATUS = 0x3A;
+    static constexpr uint8_t USER_CTRL = 0x6A;
+    static constexpr uint8_t FIFO_COUNTH = 0x72;
+    static constexpr uint8_t FIFO_R_W = 0x74;
+
+    // FIFO_EN bits of the three gyro axes and the accelerometer
+    static constexpr uint8_t FIFO_SOURCES = 0x78;
+    static constexpr uint8_t USER_FIFO_EN = 0x40;
+    static constexpr uint8_t USER_FIFO_RESET = 0x04;
+    static constexpr uint8_t FIFO_OFLOW_INT = 0x10;
+
+    // MOT_DUR follows MOT_THR, and INT_ENABLE follows INT_PIN_CFG
+    static constexpr uint8_t MOT_THR = 0x1F;
+    static constexpr uint8_t INT_PIN_CFG = 0x37;
+
+    // Keep the interrupt line high until INT_STATUS is read
+    static constexpr uint8_t LATCH_INT_EN = 0x20;
+
+    // The motion detector compares against the accel data through a 5 Hz high pass filter
+    static constexpr uint8_t ACCEL_HPF_5HZ = 0x01;
+
+    // The shift that goes with mpu6050_config::get_gyro_multiplier()
+    static constexpr uint8_t GYRO_SHIFT = 16;
+
+    // The accel, temperature and gyro registers are contiguous
+    static constexpr uint8_t SAMPLE_SIZE = 14;
+
+    // A FIFO frame holds the accel and gyro registers, in register order
+    static constexpr uint8_t FRAME_SIZE = 12;
+    static constexpr uint8_t FRAMES_PER_READ = 16;
+
+    ipass::fixed_handler_snapshot<default_handler_count> handlers;
 
     hwlib::i2c_bus &bus;
     uint8_t address{};
+    mpu6050_config config;
+
+    // Computed once from the configuration, so converting a sample does not divide
+    const int32_t gyro_multiplier;
+    const uint8_t accel_shift;
+
+    uint32_t fifo_interval{};
+    uint_fast64_t fifo_next{};
+    bool fifo_started{};
+    bool fifo_enabled{};
+    uint32_t overflows{};
+
+    uint8_t interrupts{};
+    uint8_t pending_status{};
+
+    static ipass::vector3<int16_t> decode(const uint8_t *data);
+
+    ipass::vector3<int16_t> scale_accel(const ipass::vector3<int16_t> &raw) const;
+
+    ipass::vector3<int16_t> scale_gyro(const ipass::vector3<int16_t> &raw) const;
+
+    ipass::motion_sample decode_sample(const uint8_t *accel, const uint8_t *gyro,
+                                       int16_t temperature, uint_fast64_t timestamp);
 
     ipass::vector3<int16_t> get_sensor_data(uint8_t start);
+
+    void reset_fifo();
+
+    uint8_t read_status();
 public:
-    explicit mpu6050(hwlib::i2c_bus &bus, uint8_t address = 0x68);
+    /**
+     * \brief
+     * Interrupt sources for enable_interrupts(), as in INT_ENABLE.
+     */
+    static constexpr uint8_t INTERRUPT_DATA_READY = 0x01;
+    static constexpr uint8_t INTERRUPT_MOTION = 0x40;
+
+    explicit mpu6050(hwlib::i2c_bus &bus, uint8_t address = 0x68, const mpu6050_config &config = {});
+
+    /**
+     * \brief
+     * Constructor with the configuration and the default address.
+     * @param bus
+     * @param config
+     */
+    mpu6050(hwlib::i2c_bus &bus, const mpu6050_config &config);
 
+    /**
+     * \brief
+     * Write the configuration to the chip.
+     * \details
+     * The sample rate divider, low pass filter, gyro range and accel
+     * range registers are adjacent, so they are written in one transaction.
+     */
     void initialize() override;
 
     ipass::vector3<int16_t> get_accel() override;
 
     ipass::vector3<int16_t> get_gyro() override;
+
+    /**
+     * \brief
+     * Read accel, temperature and gyro data in one transaction.
+     * \details
+     * A single register pointer write followed by one burst read of
+     * all 14 data registers, instead of a transaction per source.
+     * @return
+     */
+    ipass::motion_sample get_sample() override;
+
+    /**
+     * \brief
+     * Set up the motion detector of the chip.
+     * \details
+     * Motion is detected when an axis of the high pass filtered
+     * accelerometer data exceeds the threshold, in units of 2 mg,
+     * for the duration, in milliseconds. Enable INTERRUPT_MOTION
+     * to raise the interrupt on it.
+     * @param threshold
+     * @param duration
+     */
+    void set_motion_detection(uint8_t threshold, uint8_t duration);
+
+    /**
+     * \brief
+     * Raise the interrupt pin on the given sources.
+     * \details
+     * The sources are INTERRUPT_DATA_READY and INTERRUPT_MOTION, or 0
+     * to disable the interrupt. The pin is active high and stays high
+     * until the interrupt is acknowledged, so it can be used with
+     * use_interrupt() to process the handlers only when there is new
+     * data, or only when the sensor moves.
+     * @param sources
+     */
+    void enable_interrupts(uint8_t sources);
+
+    /**
+     * \brief
+     * Acknowledge the interrupt by reading the interrupt status.
+     * \details
+     * Returns whether one of the enabled sources raised it.
+     * @return
+     */
+    bool acknowledge_interrupt() override;
+
+    /**
+     * \brief
+     * Whether read_fifo() cleared an enabled interrupt.
+     * \details
+     * Reading the FIFO reads the interrupt status too, which clears
+     * the interrupt. It stays pending until it is acknowledged.
+     * @return
+     */
+    bool has_pending_interrupt() override;
+
+    /**
+     * \brief
+     * Start streaming samples into the FIFO of the chip.
+     * \details
+     * The samples come at the configured sample rate. The FIFO holds
+     * 1024 bytes, 85 samples, so it has to be drained in time.
+     */
+    void start_fifo();
+
+    /**
+     * \brief
+     * Stop streaming samples into the FIFO.
+     */
+    void stop_fifo();
+
+    /**
+     * \brief
+     * Read the complete samples in the FIFO, up to capacity.
+     * \details
+     * The samples are read in large block reads, and are timestamped at
+     * the sample interval, the newest sample at about the current time.
+     * If the FIFO overflowed, the frames are no longer aligned: the FIFO
+     * is reset, the overflow is counted and no samples are returned.
+     * @param samples
+     * @param capacity
+     * @return
+     */
+    uint16_t read_fifo(ipass::motion_sample *samples, uint16_t capacity);
+
+    /**
+     * \brief
+     * Read the samples in the FIFO while it is started, or else a single sample.
+     * \details
+     * Call process_samples() on the sensor the handlers are registered
+     * on, which may be a decorator, to run the handlers over the FIFO.
+     * @param samples
+     * @param capacity
+     * @return
+     */
+    uint16_t read_samples(ipass::motion_sample *samples, uint16_t capacity) override;
+
+    /**
+     * \brief
+     * The amount of times the FIFO overflowed.
+     * @return
+     */
+    uint32_t get_overflows() const;
+
+    /**
+     * \brief
+     * The configuration of the sensor.
+     * @return
+     */
+    const mpu6050_config &get_config() const;
 };
 
 
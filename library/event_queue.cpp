@@ -0,0 +1,84 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "event_queue.hpp"
+
+ipass::event_queue::event_queue(ipass::event_queue::cell *cells, uint32_t capacity)
+        : cells(cells), mask(capacity - 1), enqueue_position(0), dequeue_position(0), drop_count(0) {
+    // A cell is free for the producer at position p when its sequence is p
+    for (uint32_t i = 0; i < capacity; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool ipass::event_queue::push(const ipass::motion_event &event) {
+    uint32_t position = enqueue_position.load(std::memory_order_relaxed);
+
+    for (;;) {
+        cell &target = cells[position & mask];
+        const uint32_t sequence = target.sequence.load(std::memory_order_acquire);
+        const int32_t difference = int32_t(sequence - position);
+
+        if (difference == 0) {
+            if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                target.event = event;
+                target.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            // The consumer has not freed this cell yet, so the queue is full
+            drop_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            position = enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool ipass::event_queue::pop(ipass::motion_event &event) {
+    uint32_t position = dequeue_position.load(std::memory_order_relaxed);
+
+    for (;;) {
+        cell &target = cells[position & mask];
+        const uint32_t sequence = target.sequence.load(std::memory_order_acquire);
+        const int32_t difference = int32_t(sequence - (position + 1));
+
+        if (difference == 0) {
+            if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                event = target.event;
+                target.sequence.store(position + mask + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = dequeue_position.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool ipass::event_queue::dispatch(const ipass::motion_event &event) {
+    return push(event);
+}
+
+uint32_t ipass::event_queue::depth() const {
+    const uint32_t head = dequeue_position.load(std::memory_order_relaxed);
+    const uint32_t tail = enqueue_position.load(std::memory_order_relaxed);
+    const int32_t difference = int32_t(tail - head);
+
+    return difference > 0 ? uint32_t(difference) : 0;
+}
+
+uint32_t ipass::event_queue::dropped() const {
+    return drop_count.load(std::memory_order_relaxed);
+}
+
+uint32_t ipass::event_queue::get_capacity() const {
+    return mask + 1;
+}
@@ -0,0 +1,154 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_EVENT_QUEUE_HPP
+#define IPASS_EVENT_QUEUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include "motion_sensor.hpp"
+
+namespace ipass {
+
+    /**
+     * \brief
+     * Bounded lock-free queue of motion events.
+     * \details
+     * Every cell carries a sequence number that tells producers and
+     * consumers whose turn it is, so any amount of threads can push and
+     * pop at the same time without locks. Nothing is allocated: when the
+     * queue is full an event is dropped and counted, the sensor never
+     * waits for a consumer.
+     *
+     * The queue is a motion_dispatcher, so it can be given to a sensor
+     * directly. The events can then be popped from a main loop or by a
+     * worker_pool.
+     *
+     * Use fixed_event_queue for a queue with its own storage.
+     *
+     * \code
+     * ipass::fixed_event_queue<32> queue;
+     * sensor.set_dispatcher(&queue);
+     *
+     * for (;;) {
+     *     sensor.process_handlers();
+     *
+     *     ipass::motion_event event;
+     *     while (queue.pop(event)) {
+     *         event.call();
+     *     }
+     * }
+     * \endcode
+     */
+    class event_queue : public motion_dispatcher {
+    public:
+        /**
+         * \brief
+         * A slot in the queue.
+         */
+        struct cell {
+            std::atomic<uint32_t> sequence;
+            motion_event event;
+        };
+
+    private:
+        cell *cells;
+        uint32_t mask;
+
+        std::atomic<uint32_t> enqueue_position;
+        std::atomic<uint32_t> dequeue_position;
+        std::atomic<uint32_t> drop_count;
+
+    protected:
+        /**
+         * \brief
+         * Constructor with the storage for the queue.
+         * \details
+         * The capacity must be a power of two.
+         * @param cells
+         * @param capacity
+         */
+        event_queue(cell *cells, uint32_t capacity);
+
+    public:
+        event_queue(const event_queue &) = delete;
+
+        event_queue &operator=(const event_queue &) = delete;
+
+        /**
+         * \brief
+         * Add an event to the queue.
+         * \details
+         * Returns false and counts the event as dropped if the queue is full.
+         * @param event
+         * @return
+         */
+        bool push(const motion_event &event);
+
+        /**
+         * \brief
+         * Take the oldest event from the queue.
+         * \details
+         * Returns false if the queue is empty.
+         * @param event
+         * @return
+         */
+        bool pop(motion_event &event);
+
+        /**
+         * \brief
+         * Push the event, see push().
+         * @param event
+         * @return
+         */
+        bool dispatch(const motion_event &event) override;
+
+        /**
+         * \brief
+         * The amount of events waiting in the queue.
+         * \details
+         * While other threads are pushing or popping,
+         * this is only a snapshot.
+         * @return
+         */
+        uint32_t depth() const;
+
+        /**
+         * \brief
+         * The amount of events dropped because the queue was full.
+         * @return
+         */
+        uint32_t dropped() const;
+
+        /**
+         * \brief
+         * The amount of events the queue can hold.
+         * @return
+         */
+        uint32_t get_capacity() const;
+    };
+
+    /**
+     * \brief
+     * An event_queue with storage for Capacity events.
+     * @tparam Capacity
+     */
+    template<uint32_t Capacity>
+    class fixed_event_queue : public event_queue {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "the capacity must be a power of two");
+
+    private:
+        cell storage[Capacity];
+
+    public:
+        fixed_event_queue() : event_queue(storage, Capacity) {}
+    };
+}
+
+#endif //IPASS_EVENT_QUEUE_HPP
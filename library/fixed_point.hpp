@@ -0,0 +1,144 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_FIXED_POINT_HPP
+#define IPASS_FIXED_POINT_HPP
+
+#include <cstdint>
+
+namespace ipass {
+
+    /**
+     * \brief
+     * Fixed point format of a 16 bit sensor value.
+     * \details
+     * A value in Q(15 - Fraction).Fraction format is stored in an int16_t,
+     * with the lowest Fraction bits below the unit. Sensor data is kept
+     * in this format, so it has the full resolution of the sensor while
+     * the rules still compare plain integers. All conversions only use
+     * shifts and integer multiplies, except for the ones meant for
+     * constants, which are evaluated at compile time.
+     *
+     * \code
+     * // 0.9 g and 150 degrees per second as thresholds
+     * ipass::accel_rule flat = {ipass::motion::z_greater_then, ipass::accel_format::from_ratio(9, 10)};
+     * ipass::gyro_rule tilted = {ipass::motion::y_less_then, ipass::gyro_format::from_int(-150)};
+     * \endcode
+     * @tparam Fraction
+     */
+    template<uint8_t Fraction>
+    struct q_format {
+        static_assert(Fraction < 16, "the fraction has to fit in 16 bits");
+
+        /**
+         * \brief
+         * The amount of fraction bits.
+         */
+        constexpr static uint8_t fraction = Fraction;
+
+        /**
+         * \brief
+         * The value of 1 unit.
+         */
+        constexpr static int32_t one = int32_t(1) << Fraction;
+
+        /**
+         * \brief
+         * Convert an integer amount of units.
+         * \details
+         * The value is not clamped, it has to be in range of the format.
+         * @param value
+         * @return
+         */
+        constexpr static int16_t from_int(const int32_t value) {
+            return int16_t(value * one);
+        }
+
+        /**
+         * \brief
+         * Convert numerator / denominator units, rounded to the nearest value.
+         * \details
+         * Meant for constants. The result is not clamped to the range
+         * of an int16_t, see from_ratio() for that.
+         * @param numerator
+         * @param denominator
+         * @return
+         */
+        constexpr static int32_t scale(const int32_t numerator, const int32_t denominator) {
+            return int32_t((int64_t(numerator) * one * 2 + (numerator < 0 ? -denominator : denominator))
+                           / (int64_t(denominator) * 2));
+        }
+
+        /**
+         * \brief
+         * Convert numerator / denominator units, rounded to the nearest value.
+         * \details
+         * Meant for constants, like 9 / 10 for 0.9 units. The result
+         * is clamped to the range of the format.
+         * @param numerator
+         * @param denominator
+         * @return
+         */
+        constexpr static int16_t from_ratio(const int32_t numerator, const int32_t denominator) {
+            return scale(numerator, denominator) > INT16_MAX ? int16_t(INT16_MAX)
+                   : scale(numerator, denominator) < INT16_MIN ? int16_t(INT16_MIN)
+                   : int16_t(scale(numerator, denominator));
+        }
+
+        /**
+         * \brief
+         * The integer amount of units, rounded down.
+         * @param value
+         * @return
+         */
+        constexpr static int16_t to_int(const int16_t value) {
+            return int16_t(value >> Fraction);
+        }
+
+        /**
+         * \brief
+         * The amount of thousandths of a unit, rounded down.
+         * @param value
+         * @return
+         */
+        constexpr static int32_t to_milli(const int16_t value) {
+            return (int32_t(value) * 1000) >> Fraction;
+        }
+
+        /**
+         * \brief
+         * Convert raw sensor counts with a multiplier and shift.
+         * \details
+         * The result is (raw * multiplier) >> shift, rounded to the
+         * nearest value: a single integer multiply, no division.
+         * @param raw
+         * @param multiplier
+         * @param shift
+         * @return
+         */
+        constexpr static int16_t from_raw(const int16_t raw, const int32_t multiplier, const uint8_t shift) {
+            return int16_t((int32_t(raw) * multiplier + (int32_t(1) << shift >> 1)) >> shift);
+        }
+    };
+
+    /**
+     * \brief
+     * Format of accelerometer data: Q4.11 g, so 1 g is 2048 and the range is 16 g.
+     */
+    using accel_format = q_format<11>;
+
+    /**
+     * \brief
+     * Format of gyroscope data: Q11.4 degrees per second, so 1 degree per
+     * second is 16 and the range is 2048 degrees per second.
+     */
+    using gyro_format = q_format<4>;
+}
+
+#endif //IPASS_FIXED_POINT_HPP
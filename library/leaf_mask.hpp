@@ -0,0 +1,161 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_LEAF_MASK_HPP
+#define IPASS_LEAF_MASK_HPP
+
+#include <cstdint>
+
+namespace ipass {
+
+    /**
+     * \brief
+     * Fixed size bit set with one bit per leaf predicate.
+     * \details
+     * Used to store the results of all leaf predicates
+     * of a sample, and to describe which leaves a rule
+     * depends on.
+     */
+    struct leaf_mask {
+        /**
+         * \brief
+         * The amount of bits in a mask.
+         */
+        constexpr static uint8_t capacity = 64;
+
+        /**
+         * \brief
+         * The amount of words used to store the bits.
+         */
+        constexpr static uint8_t word_count = capacity / 32;
+
+        uint32_t words[word_count];
+
+        /**
+         * \brief
+         * 0 argument constructor.
+         * \details
+         * Construct the mask with all bits cleared.
+         */
+        leaf_mask() : words() {}
+
+        /**
+         * \brief
+         * Set the bit at the given index.
+         * @param index
+         */
+        void set(const uint8_t index) {
+            words[index / 32] |= uint32_t(1) << (index % 32);
+        }
+
+        /**
+         * \brief
+         * Flip the bit at the given index.
+         * @param index
+         */
+        void flip(const uint8_t index) {
+            words[index / 32] ^= uint32_t(1) << (index % 32);
+        }
+
+        /**
+         * \brief
+         * Get the bit at the given index.
+         * @param index
+         * @return
+         */
+        bool test(const uint8_t index) const {
+            return (words[index / 32] >> (index % 32)) & 1u;
+        }
+
+        /**
+         * \brief
+         * Clear all bits.
+         */
+        void clear() {
+            for (auto &word : words) {
+                word = 0;
+            }
+        }
+
+        /**
+         * \brief
+         * Check if the bits selected by mask equal the expected bits.
+         * @param mask
+         * @param expected
+         * @return
+         */
+        bool matches(const leaf_mask &mask, const leaf_mask &expected) const {
+            uint32_t difference = 0;
+
+            for (uint8_t i = 0; i < word_count; i++) {
+                difference |= (words[i] & mask.words[i]) ^ expected.words[i];
+            }
+
+            return difference == 0;
+        }
+
+        /**
+         * \brief
+         * Check if this mask shares any bits with the given mask.
+         * @param rhs
+         * @return
+         */
+        bool intersects(const leaf_mask &rhs) const {
+            uint32_t shared = 0;
+
+            for (uint8_t i = 0; i < word_count; i++) {
+                shared |= words[i] & rhs.words[i];
+            }
+
+            return shared != 0;
+        }
+
+        /**
+         * \brief
+         * Add all bits of the given mask to this mask.
+         * @param rhs
+         * @return
+         */
+        leaf_mask &operator|=(const leaf_mask &rhs) {
+            for (uint8_t i = 0; i < word_count; i++) {
+                words[i] |= rhs.words[i];
+            }
+
+            return *this;
+        }
+
+        /**
+         * \brief
+         * Check if two masks are equal.
+         * @param rhs
+         * @return
+         */
+        bool operator==(const leaf_mask &rhs) const {
+            for (uint8_t i = 0; i < word_count; i++) {
+                if (words[i] != rhs.words[i]) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        /**
+         * \brief
+         * Check if two masks are not equal.
+         * @param rhs
+         * @return
+         */
+        bool operator!=(const leaf_mask &rhs) const {
+            return !operator==(rhs);
+        }
+    };
+}
+
+#endif //IPASS_LEAF_MASK_HPP
@@ -0,0 +1,218 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "leaf_table.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+#if defined(__AVX2__)
+    __m256i compare(const __m256i lanes, const __m256i threshold, const ipass::rule_opcode opcode) {
+        switch (opcode) {
+            case ipass::rule_opcode::greater_then:
+                return _mm256_cmpgt_epi16(lanes, threshold);
+
+            case ipass::rule_opcode::equal_to:
+                return _mm256_cmpeq_epi16(lanes, threshold);
+
+            default:
+                return _mm256_cmpgt_epi16(threshold, lanes);
+        }
+    }
+#elif defined(__SSE2__)
+    __m128i compare(const __m128i lanes, const __m128i threshold, const ipass::rule_opcode opcode) {
+        switch (opcode) {
+            case ipass::rule_opcode::greater_then:
+                return _mm_cmpgt_epi16(lanes, threshold);
+
+            case ipass::rule_opcode::equal_to:
+                return _mm_cmpeq_epi16(lanes, threshold);
+
+            default:
+                return _mm_cmplt_epi16(lanes, threshold);
+        }
+    }
+#endif
+
+    /*
+     * Compare count lanes against the threshold,
+     * returning one bit per lane.
+     */
+    uint32_t compare_lanes(const int16_t *lanes, const uint8_t count,
+                           const ipass::rule_opcode opcode, const int16_t threshold) {
+#if defined(__AVX2__)
+        if (count == ipass::sample_block::chunk_size) {
+            const __m256i t = _mm256_set1_epi16(threshold);
+            const __m256i low = compare(_mm256_loadu_si256((const __m256i *) lanes), t, opcode);
+            const __m256i high = compare(_mm256_loadu_si256((const __m256i *) (lanes + 16)), t, opcode);
+
+            // Packing works per 128 bit lane, so the 64 bit quarters have to be put back in order
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+
+            return uint32_t(_mm256_movemask_epi8(packed));
+        }
+#elif defined(__SSE2__)
+        if (count == ipass::sample_block::chunk_size) {
+            const __m128i t = _mm_set1_epi16(threshold);
+            uint32_t result = 0;
+
+            for (uint8_t i = 0; i < 2; i++) {
+                const __m128i low = compare(_mm_loadu_si128((const __m128i *) (lanes + i * 16)), t, opcode);
+                const __m128i high = compare(_mm_loadu_si128((const __m128i *) (lanes + i * 16 + 8)), t, opcode);
+
+                result |= uint32_t(_mm_movemask_epi8(_mm_packs_epi16(low, high))) << (i * 16);
+            }
+
+            return result;
+        }
+#endif
+
+        uint32_t result = 0;
+
+        for (uint8_t i = 0; i < count; i++) {
+            bool match;
+
+            switch (opcode) {
+                case ipass::rule_opcode::greater_then:
+                    match = lanes[i] > threshold;
+                    break;
+
+                case ipass::rule_opcode::equal_to:
+                    match = lanes[i] == threshold;
+                    break;
+
+                default:
+                    match = lanes[i] < threshold;
+                    break;
+            }
+
+            result |= uint32_t(match) << i;
+        }
+
+        return result;
+    }
+}
+
+bool ipass::rule_leaf::match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    const int16_t value = (source == rule_source::gyro ? gyro : accel).data[axis];
+
+    switch (opcode) {
+        case rule_opcode::greater_then:
+            return value > threshold;
+
+        case rule_opcode::equal_to:
+            return value == threshold;
+
+        case rule_opcode::less_then:
+            return value < threshold;
+
+        case rule_opcode::call:
+            return rule->match_against(gyro, accel);
+
+        default:
+            return true;
+    }
+}
+
+ipass::leaf_table::leaf_table()
+        : leaves(), size(0), index(), indexed(false), unindexed(), unindexed_count(0) {}
+
+int16_t ipass::leaf_table::add(const ipass::rule_leaf &leaf) {
+    for (uint8_t i = 0; i < size; i++) {
+        if (leaves[i] == leaf) {
+            return i;
+        }
+    }
+
+    if (size >= leaf_mask::capacity) {
+        return -1;
+    }
+
+    leaves[size] = leaf;
+    indexed = false;
+
+    return size++;
+}
+
+void ipass::leaf_table::build_index() {
+    index.build(leaves, size);
+    unindexed_count = 0;
+
+    for (uint8_t i = 0; i < size; i++) {
+        if (leaves[i].opcode < rule_opcode::greater_then || leaves[i].opcode > rule_opcode::less_then) {
+            unindexed[unindexed_count++] = i;
+        }
+    }
+
+    indexed = true;
+}
+
+bool ipass::leaf_table::is_indexed() const {
+    return indexed;
+}
+
+void ipass::leaf_table::clear() {
+    size = 0;
+    indexed = false;
+}
+
+uint8_t ipass::leaf_table::length() const {
+    return size;
+}
+
+ipass::leaf_mask ipass::leaf_table::evaluate(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    if (indexed) {
+        leaf_mask result = index.evaluate(gyro, accel);
+
+        for (uint8_t i = 0; i < unindexed_count; i++) {
+            if (leaves[unindexed[i]].match_against(gyro, accel)) {
+                result.set(unindexed[i]);
+            }
+        }
+
+        return result;
+    }
+
+    leaf_mask result;
+
+    for (uint8_t i = 0; i < size; i++) {
+        if (leaves[i].match_against(gyro, accel)) {
+            result.set(i);
+        }
+    }
+
+    return result;
+}
+
+void ipass::leaf_table::evaluate_block(const ipass::sample_block &block, uint16_t offset, uint8_t count,
+                                       uint32_t *columns) const {
+    for (uint8_t i = 0; i < size; i++) {
+        const auto &leaf = leaves[i];
+
+        if (leaf.opcode >= rule_opcode::greater_then && leaf.opcode <= rule_opcode::less_then) {
+            const int16_t *lanes = (leaf.source == rule_source::gyro ? block.gyro : block.accel)[leaf.axis];
+            columns[i] = compare_lanes(lanes + offset, count, leaf.opcode, leaf.threshold);
+            continue;
+        }
+
+        columns[i] = 0;
+
+        for (uint8_t s = 0; s < count; s++) {
+            const auto gyro = block.get_gyro(offset + s);
+            const auto accel = block.get_accel(offset + s);
+
+            columns[i] |= uint32_t(leaf.match_against(gyro, accel)) << s;
+        }
+    }
+}
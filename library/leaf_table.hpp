@@ -0,0 +1,167 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_LEAF_TABLE_HPP
+#define IPASS_LEAF_TABLE_HPP
+
+#include <cstdint>
+#include "vector3.hpp"
+#include "leaf_mask.hpp"
+#include "rule_program.hpp"
+#include "threshold_index.hpp"
+#include "sample_block.hpp"
+
+namespace ipass {
+
+    /**
+     * \brief
+     * A single leaf predicate of a rule.
+     * \details
+     * Either a comparison of one axis against a threshold,
+     * or a call to a rule that could not be compiled.
+     */
+    struct rule_leaf {
+        rule_opcode opcode;
+        rule_source source;
+        uint8_t axis;
+        int16_t threshold;
+        const motion_rule *rule;
+
+        /**
+         * \brief
+         * Check if two leaves describe the same predicate.
+         * @param rhs
+         * @return
+         */
+        bool operator==(const rule_leaf &rhs) const {
+            return opcode == rhs.opcode
+                   && source == rhs.source
+                   && axis == rhs.axis
+                   && threshold == rhs.threshold
+                   && rule == rhs.rule;
+        }
+
+        /**
+         * \brief
+         * Match the leaf against the given data.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const;
+    };
+
+    /**
+     * \brief
+     * Set of the unique leaf predicates of all registered rules.
+     * \details
+     * Rules registered on a sensor often share leaves, like the same
+     * condition being part of several combined rules. The leaf table
+     * stores every distinct leaf once, so each one is evaluated only
+     * once per sample into a leaf_mask, after which rules only test bits.
+     *
+     * After build_index() the threshold leaves are evaluated through a
+     * threshold_index, so the cost per sample grows with the logarithm
+     * of the amount of leaves instead of linearly.
+     */
+    class leaf_table {
+    private:
+        rule_leaf leaves[leaf_mask::capacity];
+        uint8_t size;
+
+        threshold_index index;
+        bool indexed;
+
+        /*
+         * The leaves that are not covered by the index,
+         * these are evaluated one by one.
+         */
+        uint8_t unindexed[leaf_mask::capacity];
+        uint8_t unindexed_count;
+
+    public:
+        /**
+         * \brief
+         * 0 argument constructor.
+         */
+        leaf_table();
+
+        /**
+         * \brief
+         * Add a leaf to the table.
+         * \details
+         * If an equal leaf is already present, its index is returned.
+         * Otherwise the leaf is added and the new index is returned.
+         * If the table is full, -1 is returned.
+         * @param leaf
+         * @return
+         */
+        int16_t add(const rule_leaf &leaf);
+
+        /**
+         * \brief
+         * Build the threshold index for the current leaves.
+         * \details
+         * Adding a leaf invalidates the index, until the index is
+         * rebuilt evaluate() falls back to testing every leaf.
+         */
+        void build_index();
+
+        /**
+         * \brief
+         * Check if the index is up to date with the leaves.
+         * @return
+         */
+        bool is_indexed() const;
+
+        /**
+         * \brief
+         * Remove all leaves from the table.
+         */
+        void clear();
+
+        /**
+         * \brief
+         * The amount of unique leaves in the table.
+         * @return
+         */
+        uint8_t length() const;
+
+        /**
+         * \brief
+         * Evaluate every leaf once against the given data.
+         * \details
+         * Bit i of the result is set if leaf i matches.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        leaf_mask evaluate(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const;
+
+        /**
+         * \brief
+         * Evaluate every leaf against a chunk of a sample block.
+         * \details
+         * Evaluates count (at most sample_block::chunk_size) samples,
+         * starting at offset. Afterwards bit s of columns[i] is set if
+         * leaf i matches sample offset + s. The columns array must have
+         * room for length() items.
+         *
+         * Threshold leaves are compared with SSE2 or AVX2 instructions
+         * when the target supports them, and one by one otherwise.
+         * @param block
+         * @param offset
+         * @param count
+         * @param columns
+         */
+        void evaluate_block(const sample_block &block, uint16_t offset, uint8_t count, uint32_t *columns) const;
+    };
+}
+
+#endif //IPASS_LEAF_TABLE_HPP
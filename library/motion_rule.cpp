@@ -8,6 +8,7 @@
 // ==========================================================================
 
 #include "motion_rule.hpp"
+#include "rule_program.hpp"
 
 ipass::motion_rule::motion_rule()
         : gesture(motion::none), val(0) {}
@@ -64,12 +65,44 @@ bool ipass::motion_rule::match_against(const vector3<int16_t> &data) const {
     return false;
 }
 
+bool ipass::motion_rule::compile(ipass::rule_program &program) const {
+    return program.push_call(*this);
+}
+
+ipass::binary_motion_rule::binary_motion_rule(ipass::motion_rule &first, ipass::motion_rule &second)
+        : motion_rule(motion::none, 0), first(first), second(second) {}
+
+bool ipass::binary_motion_rule::evaluate(const vector3<int16_t> &gyro, const vector3<int16_t> &accel,
+                                         bool decisive) const {
+    return first.match_against(gyro, accel) == decisive
+           ? decisive
+           : second.match_against(gyro, accel);
+}
+
 ipass::combined_motion_rule::combined_motion_rule(ipass::motion_rule &first, ipass::motion_rule &second)
-        : first(first), second(second) {}
+        : binary_motion_rule(first, second) {}
 
 bool ipass::combined_motion_rule::match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
-    return first.match_against(gyro, accel)
-           && second.match_against(gyro, accel);
+    return evaluate(gyro, accel, false);
+}
+
+bool ipass::combined_motion_rule::compile(ipass::rule_program &program) const {
+    return first.compile(program)
+           && second.compile(program)
+           && program.push(rule_opcode::combine);
+}
+
+ipass::either_motion_rule::either_motion_rule(ipass::motion_rule &first, ipass::motion_rule &second)
+        : binary_motion_rule(first, second) {}
+
+bool ipass::either_motion_rule::match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    return evaluate(gyro, accel, true);
+}
+
+bool ipass::either_motion_rule::compile(ipass::rule_program &program) const {
+    return first.compile(program)
+           && second.compile(program)
+           && program.push(rule_opcode::either);
 }
 
 ipass::gyro_rule::gyro_rule(ipass::motion gesture, int16_t val)
@@ -79,6 +112,10 @@ bool ipass::gyro_rule::match_against(const vector3<int16_t> &gyro, const vector3
     return motion_rule::match_against(gyro);
 }
 
+bool ipass::gyro_rule::compile(ipass::rule_program &program) const {
+    return program.push_leaf(rule_source::gyro, gesture, val);
+}
+
 ipass::accel_rule::accel_rule(ipass::motion gesture, int16_t val)
         : motion_rule(gesture, val) {}
 
@@ -86,9 +123,18 @@ bool ipass::accel_rule::match_against(const vector3<int16_t> &gyro, const vector
     return motion_rule::match_against(accel);
 }
 
+bool ipass::accel_rule::compile(ipass::rule_program &program) const {
+    return program.push_leaf(rule_source::accel, gesture, val);
+}
+
 ipass::inverted_motion_rule::inverted_motion_rule(const ipass::motion_rule &slave)
         : motion_rule(motion::none, 0), slave(slave) {}
 
 bool ipass::inverted_motion_rule::match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
     return !slave.match_against(gyro, accel);
 }
+
+bool ipass::inverted_motion_rule::compile(ipass::rule_program &program) const {
+    return slave.compile(program)
+           && program.push(rule_opcode::invert);
+}
\ No newline at end of file
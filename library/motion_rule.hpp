@@ -38,8 +38,48 @@ namespace ipass {
         z_less_then,
     };
 
+    /**
+     * \brief
+     * The axis a motion condition looks at: 0 for x, 1 for y and 2 for z.
+     * \details
+     * The motion enum is ordered per axis as greater, equal, less.
+     * motion::none gives 0.
+     * @param gesture
+     * @return
+     */
+    constexpr uint8_t motion_axis(const motion gesture) {
+        return gesture == motion::none ? 0 : uint8_t((gesture - motion::x_greater_then) / 3);
+    }
+
+    /**
+     * \brief
+     * The comparison of a motion condition: 0 for greater, 1 for equal and 2 for less.
+     * \details
+     * motion::none gives 0.
+     * @param gesture
+     * @return
+     */
+    constexpr uint8_t motion_comparison(const motion gesture) {
+        return gesture == motion::none ? 0 : uint8_t((gesture - motion::x_greater_then) % 3);
+    }
+
+    /**
+     * \brief
+     * The motion condition with the given axis and comparison.
+     * \details
+     * The inverse of motion_axis() and motion_comparison().
+     * @param axis
+     * @param comparison
+     * @return
+     */
+    constexpr motion make_motion(const uint8_t axis, const uint8_t comparison) {
+        return motion(motion::x_greater_then + axis * 3 + comparison);
+    }
+
     class combined_motion_rule;
 
+    class rule_program;
+
     /**
      * \brief
      * Base class for a rule.
@@ -65,6 +105,55 @@ namespace ipass {
          * @return
          */
         virtual bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const = 0;
+
+        /**
+         * \brief
+         * Lower the rule into the given program.
+         * \details
+         * Append the instructions that evaluate this rule to the
+         * program. By default the rule is appended as a call to
+         * match_against(), rules that can be expressed in plain
+         * instructions override this.
+         * Returns false if the program is full.
+         * @param program
+         * @return
+         */
+        virtual bool compile(rule_program &program) const;
+    };
+
+    /**
+     * \brief
+     * Base class for a rule with two children.
+     * \details
+     * The children are evaluated with short-circuiting: when the child
+     * evaluated first already decides the result, the other one is skipped.
+     */
+    class binary_motion_rule : public motion_rule {
+    protected:
+        motion_rule &first;
+        motion_rule &second;
+
+        /**
+         * \brief
+         * Constructor with both children.
+         * @param first
+         * @param second
+         */
+        binary_motion_rule(motion_rule &first, motion_rule &second);
+
+        /**
+         * \brief
+         * Evaluate the children with short-circuiting.
+         * \details
+         * When a child results in decisive, the result is decisive
+         * without evaluating the other child: false for an and,
+         * true for an or.
+         * @param gyro
+         * @param accel
+         * @param decisive
+         * @return
+         */
+        bool evaluate(const vector3<int16_t> &gyro, const vector3<int16_t> &accel, bool decisive) const;
     };
 
     /**
@@ -75,11 +164,7 @@ namespace ipass {
      * a combined motion rule, which can be used to
      * make more complicated conditions.
      */
-    class combined_motion_rule : public motion_rule {
-    private:
-        motion_rule &first;
-        motion_rule &second;
-
+    class combined_motion_rule : public binary_motion_rule {
     public:
         /**
          * \brief
@@ -97,6 +182,46 @@ namespace ipass {
          * @return
          */
         bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const override;
+
+        /**
+         * \brief
+         * Lower both rules into the program, followed by a combine.
+         * @param program
+         * @return
+         */
+        bool compile(rule_program &program) const override;
+    };
+
+    /**
+     * \brief
+     * Rule that matches if either of two rules matches.
+     */
+    class either_motion_rule : public binary_motion_rule {
+    public:
+        /**
+         * \brief
+         * Constructor with both alternatives.
+         * @param first
+         * @param second
+         */
+        either_motion_rule(motion_rule &first, motion_rule &second);
+
+        /**
+         * \brief
+         * Will match the given data against either rule.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const override;
+
+        /**
+         * \brief
+         * Lower both rules into the program, followed by an either.
+         * @param program
+         * @return
+         */
+        bool compile(rule_program &program) const override;
     };
 
     /**
@@ -111,10 +236,23 @@ namespace ipass {
      * @param rhs
      * @return
      */
-    static combined_motion_rule operator+(motion_rule &lhs, motion_rule &rhs)  {
+    inline combined_motion_rule operator+(motion_rule &lhs, motion_rule &rhs)  {
         return ipass::combined_motion_rule{lhs, rhs};
     }
 
+    /**
+     * \brief
+     * Combine two rules, either has to match.
+     * \details
+     * The parameters are non-const for the same reason as for operator+.
+     * @param lhs
+     * @param rhs
+     * @return
+     */
+    inline either_motion_rule operator|(motion_rule &lhs, motion_rule &rhs) {
+        return ipass::either_motion_rule{lhs, rhs};
+    }
+
     /**
      * \brief
      * A motion rule that will apply to the gyroscope.
@@ -137,6 +275,14 @@ namespace ipass {
          * @return
          */
         bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const override;
+
+        /**
+         * \brief
+         * Lower the rule into the program as a gyroscope comparison.
+         * @param program
+         * @return
+         */
+        bool compile(rule_program &program) const override;
     };
 
     /**
@@ -161,6 +307,14 @@ namespace ipass {
          * @return
          */
         bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const override;
+
+        /**
+         * \brief
+         * Lower the rule into the program as an accelerometer comparison.
+         * @param program
+         * @return
+         */
+        bool compile(rule_program &program) const override;
     };
 
     /**
@@ -189,6 +343,14 @@ namespace ipass {
          * @return
          */
         bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const override;
+
+        /**
+         * \brief
+         * Lower the inverted rule into the program, followed by an invert.
+         * @param program
+         * @return
+         */
+        bool compile(rule_program &program) const override;
     };
 }
 
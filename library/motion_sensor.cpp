@@ -7,39 +7,615 @@
 //
 // ==========================================================================
 
+#include "hwlib.hpp"
 #include "motion_sensor.hpp"
 
 ipass::motion_handler::motion_handler()
-        : function(nullptr), rule(nullptr) {}
+        : function(nullptr), contextual(nullptr), context(nullptr), program(), temporal(nullptr), bound(false),
+          mode(trigger_mode::level), refractory(0), period(0) {}
 
-ipass::motion_handler::motion_handler(ipass::motion_rule &rule, ipass::motion_handler::func function)
-        : function(function), rule(&rule) {}
+ipass::motion_handler::motion_handler(const ipass::rule_program &program, ipass::motion_handler::func function,
+                                      ipass::trigger_mode mode)
+        : function(function), contextual(nullptr), context(nullptr), program(program), temporal(nullptr), bound(false),
+          mode(mode), refractory(0), period(0) {}
+
+ipass::motion_handler::motion_handler(ipass::temporal_rule &rule, ipass::motion_handler::func function,
+                                      ipass::trigger_mode mode)
+        : function(function), contextual(nullptr), context(nullptr), program(), temporal(&rule), bound(false),
+          mode(mode), refractory(0), period(0) {}
+
+ipass::motion_handler::motion_handler(const ipass::rule_program &program, ipass::motion_handler::context_func function,
+                                      void *context, ipass::trigger_mode mode)
+        : function(nullptr), contextual(function), context(context), program(program), temporal(nullptr), bound(false),
+          mode(mode), refractory(0), period(0) {}
+
+ipass::motion_handler::motion_handler(ipass::temporal_rule &rule, ipass::motion_handler::context_func function,
+                                      void *context, ipass::trigger_mode mode)
+        : function(nullptr), contextual(function), context(context), program(), temporal(&rule), bound(false),
+          mode(mode), refractory(0), period(0) {}
 
 bool ipass::motion_handler::is_free() const {
-    return function == nullptr;
+    return function == nullptr && contextual == nullptr;
+}
+
+void ipass::motion_handler::invoke(int16_t id, ipass::motion_dispatcher *dispatcher, const vector3<int16_t> &gyro,
+                                   const vector3<int16_t> &accel, uint_fast64_t timestamp) const {
+    if (dispatcher == nullptr) {
+        call(gyro, accel);
+        return;
+    }
+
+    dispatcher->dispatch({id, function, contextual, context, gyro, accel, timestamp});
+}
+
+void ipass::motion_handler::call(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    if (contextual != nullptr) {
+        contextual(gyro, accel, context);
+    } else {
+        function(gyro, accel);
+    }
+}
+
+bool ipass::motion_handler::is_due(ipass::handler_state &state, uint_fast64_t timestamp) const {
+    if (period == 0) {
+        return true;
+    }
+
+    if (!state.scheduled) {
+        state.scheduled = true;
+        state.next_due = timestamp + period;
+        return true;
+    }
+
+    if (timestamp < state.next_due) {
+        return false;
+    }
+
+    if (timestamp - state.next_due >= period) {
+        state.overruns++;
+        state.next_due = timestamp + period;
+    } else {
+        // Keep the schedule, so the rate does not drift with the sample timing
+        state.next_due += period;
+    }
+
+    return true;
+}
+
+bool ipass::motion_handler::may_call(ipass::handler_state &state, uint_fast64_t timestamp) const {
+    if (state.called && timestamp - state.last_call < refractory) {
+        return false;
+    }
+
+    state.called = true;
+    state.last_call = timestamp;
+
+    return true;
+}
+
+uint32_t ipass::motion_handler::trigger(ipass::handler_state &state, uint32_t matches, uint32_t samples) const {
+    // Shift the result of the previous sample in front of the results
+    const uint32_t before = (matches << 1) | uint32_t(state.previous);
+
+    // The highest bit in samples is the last sample
+    state.previous = (matches & ((samples >> 1) + 1)) != 0;
+
+    switch (mode) {
+        case trigger_mode::rising:
+            return matches & ~before & samples;
+
+        case trigger_mode::falling:
+            return ~matches & before & samples;
+
+        case trigger_mode::both:
+            return (matches ^ before) & samples;
+
+        default:
+            return matches & samples;
+    }
+}
+
+bool ipass::motion_handler::match_sample(const vector3<int16_t> &gyro, const vector3<int16_t> &accel,
+                                         uint_fast64_t timestamp) const {
+    return temporal != nullptr
+           ? temporal->update(gyro, accel, timestamp)
+           : program.match_against(gyro, accel);
+}
+
+bool ipass::motion_handler::match_against(ipass::handler_state &state, const ipass::leaf_mask &leaves,
+                                          const vector3<int16_t> &gyro, const vector3<int16_t> &accel,
+                                          uint_fast64_t timestamp) const {
+    const bool match = !bound ? match_sample(gyro, accel, timestamp)
+                       : temporal != nullptr ? temporal->update(temporal->match_against(leaves), timestamp)
+                       : program.match_against(leaves);
+
+    return trigger(state, uint32_t(match), 1u) && may_call(state, timestamp);
+}
+
+uint32_t ipass::motion_handler::match_block(ipass::handler_state &state, const uint32_t *columns,
+                                            uint32_t samples, const ipass::sample_block &block,
+                                            uint16_t offset) const {
+    uint32_t result;
+
+    if (period != 0) {
+        // Only evaluate the samples the handler is due on, one at a time
+        result = 0;
+
+        for (uint8_t s = 0; s < sample_block::chunk_size && ((samples >> s) & 1u); s++) {
+            const uint_fast64_t timestamp = block.get_timestamp(offset + s);
+
+            if (!is_due(state, timestamp)) {
+                continue;
+            }
+
+            leaf_mask leaves;
+
+            for (uint8_t i = 0; i < leaf_mask::capacity; i++) {
+                if ((columns[i] >> s) & 1u) {
+                    leaves.set(i);
+                }
+            }
+
+            if (match_against(state, leaves, block.get_gyro(offset + s), block.get_accel(offset + s), timestamp)) {
+                result |= uint32_t(1) << s;
+            }
+        }
+
+        return result;
+    }
+
+    if (!bound) {
+        result = 0;
+
+        for (uint8_t s = 0; s < sample_block::chunk_size && ((samples >> s) & 1u); s++) {
+            const uint16_t index = offset + s;
+
+            if (match_sample(block.get_gyro(index), block.get_accel(index), block.get_timestamp(index))) {
+                result |= uint32_t(1) << s;
+            }
+        }
+    } else if (temporal == nullptr) {
+        result = program.match_block(columns, samples);
+    } else {
+        uint32_t conditions[temporal_rule::max_conditions];
+        const uint8_t length = temporal->length();
+
+        for (uint8_t i = 0; i < length; i++) {
+            conditions[i] = temporal->get_condition(i).match_block(columns, samples);
+        }
+
+        // The temporal state has to advance one sample at a time
+        result = 0;
+
+        for (uint8_t s = 0; s < sample_block::chunk_size && ((samples >> s) & 1u); s++) {
+            uint32_t matches = 0;
+
+            for (uint8_t i = 0; i < length; i++) {
+                matches |= ((conditions[i] >> s) & 1u) << i;
+            }
+
+            if (temporal->update(matches, block.get_timestamp(offset + s))) {
+                result |= uint32_t(1) << s;
+            }
+        }
+    }
+
+    result = trigger(state, result, samples);
+
+    if (refractory == 0) {
+        return result;
+    }
+
+    for (uint8_t s = 0; s < sample_block::chunk_size; s++) {
+        if (((result >> s) & 1u) && !may_call(state, block.get_timestamp(offset + s))) {
+            result &= ~(uint32_t(1) << s);
+        }
+    }
+
+    return result;
+}
+
+ipass::handler_table::handler_table(ipass::motion_handler *handlers, uint16_t *ids, uint16_t *slots,
+                                    ipass::handler_state *states, uint16_t capacity)
+        : handlers(handlers), ids(ids), slots(slots), states(states), capacity(capacity > 0x7FFF ? 0x7FFF : capacity),
+          count(0), next_free(0) {}
+
+int16_t ipass::handler_table::add(const ipass::motion_handler &handler) {
+    if (count >= capacity) {
+        return -1;
+    }
+
+    const uint16_t id = next_free;
+    next_free = slots[id];
+
+    slots[id] = count;
+    ids[count] = id;
+    handlers[count++] = handler;
+    states[id] = handler_state();
+
+    return int16_t(id);
+}
+
+bool ipass::handler_table::remove(int16_t id) {
+    if (find(id) == nullptr) {
+        return false;
+    }
+
+    // Move the last handler into the freed position
+    const uint16_t position = slots[id];
+    const uint16_t last = --count;
+
+    handlers[position] = handlers[last];
+    ids[position] = ids[last];
+    slots[ids[position]] = position;
+
+    handlers[last] = motion_handler();
+
+    slots[id] = next_free;
+    next_free = uint16_t(id);
+
+    return true;
+}
+
+ipass::motion_handler *ipass::handler_table::find(int16_t id) {
+    if (id < 0 || uint16_t(id) >= capacity) {
+        return nullptr;
+    }
+
+    // A free slot holds the next free id instead, which can't point back at the id
+    const uint16_t position = slots[id];
+
+    if (position >= count || ids[position] != uint16_t(id)) {
+        return nullptr;
+    }
+
+    return &handlers[position];
+}
+
+int16_t ipass::handler_table::get_id(uint16_t position) const {
+    return position < count ? int16_t(ids[position]) : int16_t(-1);
+}
+
+ipass::handler_state &ipass::handler_table::get_state(int16_t id) {
+    return states[id];
+}
+
+bool ipass::handler_table::assign(const ipass::handler_table &other) {
+    if (other.capacity != capacity) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < other.count; i++) {
+        handlers[i] = other.handlers[i];
+        ids[i] = other.ids[i];
+    }
+
+    // Clear the handlers that are not in the other table anymore
+    for (uint16_t i = other.count; i < count; i++) {
+        handlers[i] = motion_handler();
+    }
+
+    for (uint16_t i = 0; i < capacity; i++) {
+        slots[i] = other.slots[i];
+    }
+
+    count = other.count;
+    next_free = other.next_free;
+
+    return true;
+}
+
+uint16_t ipass::handler_table::length() const {
+    return count;
+}
+
+uint16_t ipass::handler_table::get_capacity() const {
+    return capacity;
 }
 
-ipass::motion_sensor::motion_sensor() : handlers() {}
+bool ipass::handler_table::is_full() const {
+    return count >= capacity;
+}
+
+void ipass::handler_table::clear() {
+    for (uint16_t i = 0; i < count; i++) {
+        handlers[i] = motion_handler();
+    }
+
+    for (uint16_t i = 0; i < capacity; i++) {
+        slots[i] = uint16_t(i + 1);
+        states[i] = handler_state();
+    }
+
+    count = 0;
+    next_free = 0;
+}
+
+ipass::motion_handler *ipass::handler_table::begin() {
+    return handlers;
+}
+
+ipass::motion_handler *ipass::handler_table::end() {
+    return handlers + count;
+}
 
-int8_t ipass::motion_sensor::when(motion_rule &rule, motion_handler::func function) {
-    const int8_t size = sizeof(handlers) / sizeof(handlers[0]);
+ipass::handler_snapshot::handler_snapshot(ipass::handler_table &table)
+        : handlers(&table), leaves(), readers(0) {}
 
-    for (int8_t i = 0; i < size; i++) {
-        if (handlers[i].is_free()) {
-            handlers[i] = motion_handler(rule, function);
-            return i;
+ipass::motion_sensor::motion_sensor(ipass::handler_snapshot &snapshot)
+        : primary(&snapshot), spare(nullptr), current(&snapshot),
+          next_tick(0), rescheduled(true), interrupt(nullptr), source(nullptr), dispatcher(nullptr) {}
+
+ipass::motion_sensor::motion_sensor(ipass::motion_sensor *slave)
+        : primary(nullptr), spare(nullptr), current(nullptr),
+          next_tick(0), rescheduled(true), interrupt(nullptr), source(slave), dispatcher(nullptr) {}
+
+bool ipass::motion_sensor::take_handlers() {
+    if (primary != nullptr) {
+        return true;
+    }
+
+    if (source == nullptr || !source->take_handlers() || source->spare != nullptr
+        || source->primary->handlers->length() != 0) {
+        return false;
+    }
+
+    primary = source->primary;
+    current.store(primary);
+
+    source->primary = nullptr;
+    source->current.store(nullptr);
+    return true;
+}
+
+ipass::handler_snapshot &ipass::motion_sensor::acquire_snapshot() {
+    for (;;) {
+        handler_snapshot *snapshot = current.load();
+        snapshot->readers.fetch_add(1);
+
+        // If an update was published in between, the snapshot may already be changing
+        if (current.load() == snapshot) {
+            return *snapshot;
         }
+
+        snapshot->readers.fetch_sub(1);
+    }
+}
+
+void ipass::motion_sensor::release_snapshot(ipass::handler_snapshot &snapshot) {
+    snapshot.readers.fetch_sub(1);
+}
+
+ipass::handler_snapshot &ipass::motion_sensor::begin_update() {
+    while (updating.test_and_set(std::memory_order_acquire)) {}
+
+    handler_snapshot *active = current.load();
+
+    if (spare == nullptr) {
+        return *active;
+    }
+
+    handler_snapshot &target = active == primary ? *spare : *primary;
+
+    // Wait for processing that started before the previous update
+    while (target.readers.load() != 0) {}
+
+    target.handlers->assign(*active->handlers);
+    target.leaves = active->leaves;
+
+    return target;
+}
+
+void ipass::motion_sensor::end_update(ipass::handler_snapshot &target, bool publish) {
+    if (publish) {
+        current.store(&target);
+        rescheduled.store(true);
     }
 
-    return -1;
+    updating.clear(std::memory_order_release);
 }
 
-void ipass::motion_sensor::remove_handler(int8_t index) {
-    if (index >= handler_count || index < 0) {
+void ipass::motion_sensor::rebind_handlers(ipass::handler_snapshot &snapshot) {
+    snapshot.leaves.clear();
+
+    for (auto &handler : *snapshot.handlers) {
+        handler.bound = handler.temporal != nullptr
+                        ? handler.temporal->bind(snapshot.leaves)
+                        : handler.program.bind(snapshot.leaves);
+    }
+
+    snapshot.leaves.build_index();
+}
+
+bool ipass::motion_sensor::use_handlers(ipass::handler_snapshot &snapshot) {
+    if (spare != nullptr || (primary != nullptr && primary->handlers->length() != 0)
+        || snapshot.handlers->length() != 0) {
+        return false;
+    }
+
+    primary = &snapshot;
+    current.store(&snapshot);
+    return true;
+}
+
+bool ipass::motion_sensor::use_snapshots(ipass::handler_snapshot &snapshot) {
+    if (!take_handlers() || spare != nullptr || primary->handlers->length() != 0
+        || snapshot.handlers->length() != 0
+        || snapshot.handlers->get_capacity() != primary->handlers->get_capacity()) {
+        return false;
+    }
+
+    spare = &snapshot;
+    return true;
+}
+
+void ipass::motion_sensor::set_dispatcher(ipass::motion_dispatcher *target) {
+    dispatcher = target;
+}
+
+void ipass::motion_sensor::use_interrupt(hwlib::pin_in *pin) {
+    interrupt = pin;
+}
+
+uint16_t ipass::motion_sensor::get_handler_count() const {
+    const handler_snapshot *snapshot = current.load();
+    return snapshot != nullptr ? snapshot->handlers->length() : uint16_t(0);
+}
+
+int16_t ipass::motion_sensor::get_handler_id(uint16_t position) const {
+    const handler_snapshot *snapshot = current.load();
+    return snapshot != nullptr ? snapshot->handlers->get_id(position) : int16_t(-1);
+}
+
+int16_t ipass::motion_sensor::add_handler(const ipass::motion_handler &prototype) {
+    if (!take_handlers() || prototype.is_free()) {
+        return -1;
+    }
+
+    handler_snapshot &target = begin_update();
+
+    if (target.handlers->is_full()) {
+        end_update(target, false);
+        return -1;
+    }
+
+    motion_handler handler = prototype;
+
+    // The leaves of the current handlers keep their index, so their bindings stay valid
+    handler.bound = handler.temporal != nullptr
+                    ? handler.temporal->bind(target.leaves)
+                    : handler.program.bind(target.leaves);
+
+    // Drop the leaves this handler did manage to add, in a copy they are only unused
+    if (!handler.bound && spare == nullptr) {
+        rebind_handlers(target);
+    }
+
+    target.leaves.build_index();
+
+    if (handler.temporal != nullptr) {
+        handler.temporal->reset();
+    }
+
+    const int16_t id = target.handlers->add(handler);
+
+    // No snapshot in use has a handler with this id, so its state is free
+    primary->handlers->get_state(id) = handler_state();
+
+    end_update(target, true);
+    return id;
+}
+
+int16_t ipass::motion_sensor::when(motion_rule &rule, motion_handler::func function, trigger_mode mode) {
+    rule_program program;
+
+    // A tree that does not fit a program is evaluated as a single leaf
+    if (!rule.compile(program)) {
+        program.clear();
+        program.push_call(rule);
+    }
+
+    return add_handler(motion_handler(program, function, mode));
+}
+
+int16_t ipass::motion_sensor::when(const ipass::rule_program &program, motion_handler::func function,
+                                   trigger_mode mode) {
+    return add_handler(motion_handler(program, function, mode));
+}
+
+int16_t ipass::motion_sensor::when(ipass::temporal_rule &rule, motion_handler::func function, trigger_mode mode) {
+    return add_handler(motion_handler(rule, function, mode));
+}
+
+int16_t ipass::motion_sensor::when(motion_rule &rule, motion_handler::context_func function, void *context,
+                                   trigger_mode mode) {
+    rule_program program;
+
+    // A tree that does not fit a program is evaluated as a single leaf
+    if (!rule.compile(program)) {
+        program.clear();
+        program.push_call(rule);
+    }
+
+    return add_handler(motion_handler(program, function, context, mode));
+}
+
+int16_t ipass::motion_sensor::when(const ipass::rule_program &program, motion_handler::context_func function,
+                                   void *context, trigger_mode mode) {
+    return add_handler(motion_handler(program, function, context, mode));
+}
+
+int16_t ipass::motion_sensor::when(ipass::temporal_rule &rule, motion_handler::context_func function,
+                                   void *context, trigger_mode mode) {
+    return add_handler(motion_handler(rule, function, context, mode));
+}
+
+void ipass::motion_sensor::remove_handler(int16_t id) {
+    if (primary == nullptr) {
+        return;
+    }
+
+    handler_snapshot &target = begin_update();
+
+    if (!target.handlers->remove(id)) {
+        end_update(target, false);
+        return;
+    }
+
+    bool temporal = false;
+
+    for (auto &handler : *target.handlers) {
+        temporal = temporal || handler.temporal != nullptr;
+    }
+
+    // Temporal rules are bound in place, rebinding them would change the current snapshot
+    if (spare == nullptr || !temporal) {
+        rebind_handlers(target);
+    }
+
+    end_update(target, true);
+}
+
+void ipass::motion_sensor::set_refractory(int16_t id, uint_fast64_t period) {
+    if (primary == nullptr) {
         return;
     }
 
-    handlers[index] = motion_handler();
+    handler_snapshot &target = begin_update();
+    motion_handler *handler = target.handlers->find(id);
+
+    if (handler != nullptr) {
+        handler->refractory = period;
+    }
+
+    end_update(target, handler != nullptr);
+}
+
+void ipass::motion_sensor::set_period(int16_t id, uint_fast64_t period) {
+    if (primary == nullptr) {
+        return;
+    }
+
+    handler_snapshot &target = begin_update();
+    motion_handler *handler = target.handlers->find(id);
+
+    if (handler != nullptr) {
+        handler->period = period;
+    }
+
+    end_update(target, handler != nullptr);
+}
+
+uint32_t ipass::motion_sensor::get_overruns(int16_t id) {
+    if (primary == nullptr) {
+        return 0;
+    }
+
+    handler_snapshot &snapshot = acquire_snapshot();
+    const bool found = snapshot.handlers->find(id) != nullptr;
+    release_snapshot(snapshot);
+
+    return found ? primary->handlers->get_state(id).overruns : 0;
 }
 
 int16_t ipass::motion_sensor::get_accel_x() {
@@ -66,53 +642,274 @@ int16_t ipass::motion_sensor::get_gyro_z() {
     return get_gyro().z;
 }
 
+uint_fast64_t ipass::motion_sensor::get_timestamp() {
+    return hwlib::now_us();
+}
+
+ipass::motion_sample ipass::motion_sensor::get_sample() {
+    const auto gyro = get_gyro();
+    const auto accel = get_accel();
+
+    return {gyro, accel, 0, get_timestamp()};
+}
+
+uint16_t ipass::motion_sensor::read_samples(ipass::motion_sample *samples, uint16_t capacity) {
+    if (capacity == 0) {
+        return 0;
+    }
+
+    samples[0] = get_sample();
+    return 1;
+}
+
+bool ipass::motion_sensor::acknowledge_interrupt() {
+    return true;
+}
+
+bool ipass::motion_sensor::has_pending_interrupt() {
+    return false;
+}
+
 void ipass::motion_sensor::process_handlers() {
-    vector3<int16_t> gyro = get_gyro();
-    vector3<int16_t> accel = get_accel();
-
-    for (const auto &handler : handlers) {
-        /*
-         * The handlers array is not sorted and can be
-         * empty at random locations, so every item
-         * has to be checked.
-         */
-        if (handler.is_free()) {
-            continue;
+    // Without handlers there is nothing to read the sensor for
+    if (primary == nullptr) {
+        return;
+    }
+
+    // The sensor has nothing new, leave the bus alone
+    if (interrupt != nullptr
+        && ((!interrupt->get() && !has_pending_interrupt()) || !acknowledge_interrupt())) {
+        return;
+    }
+
+    // Nothing is due, don't even read the sensor
+    if (!rescheduled.exchange(false) && get_timestamp() < next_tick) {
+        return;
+    }
+
+    process_sample(get_sample());
+}
+
+void ipass::motion_sensor::process_handlers(const ipass::motion_sample &sample) {
+    if (primary == nullptr) {
+        return;
+    }
+
+    if (!rescheduled.exchange(false) && sample.timestamp < next_tick) {
+        return;
+    }
+
+    process_sample(sample);
+}
+
+void ipass::motion_sensor::process_sample(const ipass::motion_sample &sample) {
+    const vector3<int16_t> &gyro = sample.gyro;
+    const vector3<int16_t> &accel = sample.accel;
+    const uint_fast64_t timestamp = sample.timestamp;
+
+    handler_snapshot &snapshot = acquire_snapshot();
+    handler_table &table = *snapshot.handlers;
+
+    const leaf_mask results = snapshot.leaves.evaluate(gyro, accel);
+    uint_fast64_t earliest = UINT_FAST64_MAX;
+
+    for (uint16_t i = 0; i < table.length(); i++) {
+        const motion_handler &handler = table.begin()[i];
+        const int16_t id = table.get_id(i);
+        handler_state &state = primary->handlers->get_state(id);
+
+        if (handler.is_due(state, timestamp) && handler.match_against(state, results, gyro, accel, timestamp)) {
+            handler.invoke(id, dispatcher, gyro, accel, timestamp);
+        }
+
+        const uint_fast64_t due = handler.period == 0 ? 0 : state.next_due;
+        earliest = due < earliest ? due : earliest;
+    }
+
+    next_tick = earliest;
+    release_snapshot(snapshot);
+}
+
+void ipass::motion_sensor::process_block(ipass::handler_snapshot &snapshot, const ipass::sample_block &block) {
+    uint32_t columns[leaf_mask::capacity];
+
+    handler_table &table = *snapshot.handlers;
+    handler_table &states = *primary->handlers;
+
+    // Handlers with a period build the leaf results of a sample from all columns
+    for (uint8_t i = snapshot.leaves.length(); i < leaf_mask::capacity; i++) {
+        columns[i] = 0;
+    }
+
+    for (uint16_t offset = 0; offset < block.count; offset += sample_block::chunk_size) {
+        const uint8_t count = block.count - offset < sample_block::chunk_size
+                              ? uint8_t(block.count - offset)
+                              : sample_block::chunk_size;
+
+        const uint32_t samples = count == 32 ? ~uint32_t(0) : (uint32_t(1) << count) - 1;
+
+        snapshot.leaves.evaluate_block(block, offset, count, columns);
+
+        uint32_t any = 0;
+
+        for (uint16_t i = 0; i < table.length(); i++) {
+            handler_state &state = states.get_state(table.get_id(i));
+
+            state.pending = table.begin()[i].match_block(state, columns, samples, block, offset);
+            any |= state.pending;
+        }
+
+        // Only visit the samples that matched at least one handler
+        for (uint8_t s = 0; s < count; s++) {
+            if (!((any >> s) & 1u)) {
+                continue;
+            }
+
+            const auto gyro = block.get_gyro(offset + s);
+            const auto accel = block.get_accel(offset + s);
+            const auto timestamp = block.get_timestamp(offset + s);
+
+            for (uint16_t i = 0; i < table.length(); i++) {
+                const int16_t id = table.get_id(i);
+
+                if ((states.get_state(id).pending >> s) & 1u) {
+                    table.begin()[i].invoke(id, dispatcher, gyro, accel, timestamp);
+                }
+            }
+        }
+    }
+}
+
+void ipass::motion_sensor::process_handlers(const ipass::sample_block &block) {
+    if (primary == nullptr) {
+        return;
+    }
+
+    handler_snapshot &snapshot = acquire_snapshot();
+    process_block(snapshot, block);
+    release_snapshot(snapshot);
+}
+
+void ipass::motion_sensor::process_handlers(const ipass::motion_sample *samples, uint32_t count) {
+    if (primary == nullptr) {
+        return;
+    }
+
+    constexpr uint8_t size = sample_block::chunk_size;
+
+    int16_t lanes[6][size];
+    uint_fast64_t timestamps[size];
+
+    sample_block block = {
+        {lanes[0], lanes[1], lanes[2]},
+        {lanes[3], lanes[4], lanes[5]},
+        0, 0, 0, timestamps
+    };
+
+    handler_snapshot &snapshot = acquire_snapshot();
+
+    for (uint32_t offset = 0; offset < count; offset += size) {
+        block.count = count - offset < size ? uint16_t(count - offset) : size;
+
+        // Rearrange the chunk into lanes, so the leaves can be compared a chunk at a time
+        for (uint8_t s = 0; s < block.count; s++) {
+            const motion_sample &sample = samples[offset + s];
+
+            lanes[0][s] = sample.gyro.x;
+            lanes[1][s] = sample.gyro.y;
+            lanes[2][s] = sample.gyro.z;
+            lanes[3][s] = sample.accel.x;
+            lanes[4][s] = sample.accel.y;
+            lanes[5][s] = sample.accel.z;
+            timestamps[s] = sample.timestamp;
         }
 
-        if ((*handler.rule).match_against(gyro, accel)) {
-            handler.function(gyro, accel);
+        process_block(snapshot, block);
+    }
+
+    release_snapshot(snapshot);
+}
+
+uint32_t ipass::motion_sensor::process_samples() {
+    motion_sample samples[sample_batch];
+    uint32_t total = 0;
+
+    for (;;) {
+        const uint16_t count = read_samples(samples, sample_batch);
+
+        process_handlers(samples, count);
+        total += count;
+
+        if (count < sample_batch) {
+            return total;
         }
     }
 }
 
 ipass::cached_motion_sensor::cached_motion_sensor(ipass::motion_sensor &slave)
-    : slave(slave) {}
+    : motion_sensor(&slave), sample(), slave(slave) {}
 
 void ipass::cached_motion_sensor::initialize() {
     slave.initialize();
 }
 
 ipass::vector3<int16_t> ipass::cached_motion_sensor::get_accel() {
-    return accel;
+    return sample.accel;
 }
 
 ipass::vector3<int16_t> ipass::cached_motion_sensor::get_gyro() {
-    return gyro;
+    return sample.gyro;
+}
+
+uint_fast64_t ipass::cached_motion_sensor::get_timestamp() {
+    return sample.timestamp;
+}
+
+ipass::motion_sample ipass::cached_motion_sensor::get_sample() {
+    return sample;
+}
+
+uint16_t ipass::cached_motion_sensor::read_samples(ipass::motion_sample *samples, uint16_t capacity) {
+    const uint16_t count = slave.read_samples(samples, capacity);
+
+    if (count != 0) {
+        sample = samples[count - 1];
+    }
+
+    return count;
+}
+
+bool ipass::cached_motion_sensor::acknowledge_interrupt() {
+    return slave.acknowledge_interrupt();
+}
+
+bool ipass::cached_motion_sensor::has_pending_interrupt() {
+    return slave.has_pending_interrupt();
 }
 
 void ipass::cached_motion_sensor::refresh() {
-    gyro = slave.get_gyro();
-    accel = slave.get_accel();
+    sample = slave.get_sample();
 }
 
 ipass::corrected_motion_sensor::corrected_motion_sensor(ipass::motion_sensor &slave, ipass::vector3<int16_t> correction)
-        : slave(slave), correction(correction) {}
+        : motion_sensor(&slave), slave(slave), correction(correction) {}
 
 void ipass::corrected_motion_sensor::initialize() {
     slave.initialize();
 }
 
+uint_fast64_t ipass::corrected_motion_sensor::get_timestamp() {
+    return slave.get_timestamp();
+}
+
+bool ipass::corrected_motion_sensor::acknowledge_interrupt() {
+    return slave.acknowledge_interrupt();
+}
+
+bool ipass::corrected_motion_sensor::has_pending_interrupt() {
+    return slave.has_pending_interrupt();
+}
+
 ipass::gyro_corrected_motion_sensor::gyro_corrected_motion_sensor(ipass::motion_sensor &slave,
                                                                   const ipass::vector3<int16_t> &correction)
         : corrected_motion_sensor(slave, correction) {}
@@ -128,6 +925,23 @@ ipass::vector3<int16_t> ipass::gyro_corrected_motion_sensor::get_gyro() {
     return base;
 }
 
+ipass::motion_sample ipass::gyro_corrected_motion_sensor::get_sample() {
+    auto sample = slave.get_sample();
+    sample.gyro -= correction;
+
+    return sample;
+}
+
+uint16_t ipass::gyro_corrected_motion_sensor::read_samples(ipass::motion_sample *samples, uint16_t capacity) {
+    const uint16_t count = slave.read_samples(samples, capacity);
+
+    for (uint16_t i = 0; i < count; i++) {
+        samples[i].gyro -= correction;
+    }
+
+    return count;
+}
+
 ipass::accel_corrected_motion_sensor::accel_corrected_motion_sensor(ipass::motion_sensor &slave,
                                                                     const ipass::vector3<int16_t> &correction)
         : corrected_motion_sensor(slave, correction) {}
@@ -142,4 +956,21 @@ ipass::vector3<int16_t> ipass::accel_corrected_motion_sensor::get_accel() {
 
 ipass::vector3<int16_t> ipass::accel_corrected_motion_sensor::get_gyro() {
     return slave.get_gyro();
-}
\ No newline at end of file
+}
+
+ipass::motion_sample ipass::accel_corrected_motion_sensor::get_sample() {
+    auto sample = slave.get_sample();
+    sample.accel -= correction;
+
+    return sample;
+}
+
+uint16_t ipass::accel_corrected_motion_sensor::read_samples(ipass::motion_sample *samples, uint16_t capacity) {
+    const uint16_t count = slave.read_samples(samples, capacity);
+
+    for (uint16_t i = 0; i < count; i++) {
+        samples[i].accel -= correction;
+    }
+
+    return count;
+}
@@ -12,8 +12,16 @@
 #ifndef IPASS_MOTION_SENSOR_HPP
 #define IPASS_MOTION_SENSOR_HPP
 
+#include <atomic>
+#include <utility>
+#include "hwlib.hpp"
+#include "fixed_point.hpp"
 #include "vector3.hpp"
 #include "motion_rule.hpp"
+#include "rule_program.hpp"
+#include "leaf_table.hpp"
+#include "sample_block.hpp"
+#include "temporal_rule.hpp"
 
 /**
  * \mainpage
@@ -61,6 +69,41 @@
  */
 namespace ipass {
 
+    /**
+     * \brief
+     * When a handler is called for its rule.
+     * \details
+     * With level, the handler is called for every sample its rule
+     * matches. With rising it is only called for the sample the rule
+     * starts matching, with falling for the sample the rule stops
+     * matching, and with both for either transition.
+     */
+    enum class trigger_mode : uint8_t {
+        level,
+        rising,
+        falling,
+        both
+    };
+
+    class motion_dispatcher;
+
+    /**
+     * \brief
+     * The state a handler keeps between samples.
+     * \details
+     * Kept apart from the motion_handler, so a handler table can be
+     * copied while the sensor is processing its handlers.
+     */
+    struct handler_state {
+        uint_fast64_t last_call;
+        uint_fast64_t next_due;
+        uint32_t pending;
+        uint32_t overruns;
+        bool previous;
+        bool called;
+        bool scheduled;
+    };
+
     /**
      * \brief
      * The motion handler combines a rule with an action.
@@ -75,9 +118,133 @@ namespace ipass {
     public:
         using func = void (*)(const vector3<int16_t> &, const vector3<int16_t> &);
 
+        /**
+         * \brief
+         * Callback that also gets the context given on registration.
+         */
+        using context_func = void (*)(const vector3<int16_t> &, const vector3<int16_t> &, void *);
+
     private:
         func function;
-        motion_rule *rule;
+        context_func contextual;
+        void *context;
+        rule_program program;
+        temporal_rule *temporal;
+
+        /*
+         * Whether the rule is bound to the leaf table of the sensor.
+         * Otherwise the table was full, and the rule is matched
+         * against the data of every sample by itself.
+         */
+        bool bound;
+
+        trigger_mode mode;
+        uint_fast64_t refractory;
+        uint_fast64_t period;
+
+        /**
+         * \brief
+         * Check if the handler has to be evaluated at the given time.
+         * \details
+         * A handler without a period is always due. Otherwise the next
+         * evaluation is scheduled one period after the previous one; if
+         * a whole period was missed, an overrun is counted and the
+         * schedule restarts at the given time.
+         * @param state
+         * @param timestamp
+         * @return
+         */
+        bool is_due(handler_state &state, uint_fast64_t timestamp) const;
+
+        /**
+         * \brief
+         * Check if the handler may be called at the given time.
+         * \details
+         * Returns false if the handler is within its refractory period,
+         * otherwise the call is recorded and true is returned.
+         * @param state
+         * @param timestamp
+         * @return
+         */
+        bool may_call(handler_state &state, uint_fast64_t timestamp) const;
+
+        /**
+         * \brief
+         * Apply the trigger mode to the rule results of consecutive samples.
+         * \details
+         * Bit s of matches is the rule result of sample s, samples has a bit
+         * set for every sample. Returns the samples the handler triggers on,
+         * and remembers the result of the last sample for the next call.
+         * @param state
+         * @param matches
+         * @param samples
+         * @return
+         */
+        uint32_t trigger(handler_state &state, uint32_t matches, uint32_t samples) const;
+
+        /**
+         * \brief
+         * Match the rule of an unbound handler against the data of a sample.
+         * @param gyro
+         * @param accel
+         * @param timestamp
+         * @return
+         */
+        bool match_sample(const vector3<int16_t> &gyro, const vector3<int16_t> &accel,
+                          uint_fast64_t timestamp) const;
+
+        /**
+         * \brief
+         * Match the handler against the leaf results of a sample.
+         * \details
+         * Returns true if the handler triggers for the rule result
+         * and is not within its refractory period. An unbound handler
+         * uses the data of the sample instead of the leaf results.
+         * @param state
+         * @param leaves
+         * @param gyro
+         * @param accel
+         * @param timestamp
+         * @return
+         */
+        bool match_against(handler_state &state, const leaf_mask &leaves, const vector3<int16_t> &gyro,
+                           const vector3<int16_t> &accel, uint_fast64_t timestamp) const;
+
+        /**
+         * \brief
+         * Match the handler against leaf columns of a chunk of samples.
+         * \details
+         * Bit s of the result is set if the handler triggers on
+         * sample s and may be called for it.
+         * @param state
+         * @param columns
+         * @param samples
+         * @param block
+         * @param offset
+         * @return
+         */
+        uint32_t match_block(handler_state &state, const uint32_t *columns, uint32_t samples,
+                             const sample_block &block, uint16_t offset) const;
+
+        /**
+         * \brief
+         * Call the function of the handler, with its context if it has one.
+         * @param gyro
+         * @param accel
+         */
+        void call(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const;
+
+        /**
+         * \brief
+         * Run the handler for a sample, or hand it to the dispatcher if there is one.
+         * @param id
+         * @param dispatcher
+         * @param gyro
+         * @param accel
+         * @param timestamp
+         */
+        void invoke(int16_t id, motion_dispatcher *dispatcher, const vector3<int16_t> &gyro,
+                    const vector3<int16_t> &accel, uint_fast64_t timestamp) const;
 
     public:
         /**
@@ -92,13 +259,51 @@ namespace ipass {
          * \brief
          * 2 argument constructor with all requried values.
          * \details
-         * Construct the motion handler with the given rule
-         * and function. The handler does not have ownership of
-         * the given rule.
+         * Construct the motion handler with the given compiled
+         * rule, function and trigger mode.
+         * @param program
+         * @param function
+         * @param mode
+         */
+        motion_handler(const rule_program &program, func function, trigger_mode mode = trigger_mode::level);
+
+        /**
+         * \brief
+         * 2 argument constructor for a temporal rule.
+         * \details
+         * Construct the motion handler with the given temporal
+         * rule, function and trigger mode. The handler does not have
+         * ownership of the given rule.
+         * @param rule
+         * @param function
+         * @param mode
+         */
+        motion_handler(temporal_rule &rule, func function, trigger_mode mode = trigger_mode::level);
+
+        /**
+         * \brief
+         * Constructor for a compiled rule with a context callback.
+         * \details
+         * The context is passed to every call of the function.
+         * The handler does not have ownership of the context.
+         * @param program
+         * @param function
+         * @param context
+         * @param mode
+         */
+        motion_handler(const rule_program &program, context_func function, void *context,
+                       trigger_mode mode = trigger_mode::level);
+
+        /**
+         * \brief
+         * Constructor for a temporal rule with a context callback.
          * @param rule
          * @param function
+         * @param context
+         * @param mode
          */
-        motion_handler(motion_rule &rule, func function);
+        motion_handler(temporal_rule &rule, context_func function, void *context,
+                       trigger_mode mode = trigger_mode::level);
 
         /**
          * \brief
@@ -108,61 +313,681 @@ namespace ipass {
         bool is_free() const;
     };
 
+    /**
+     * \brief
+     * A handler call that is dispatched instead of run directly.
+     * \details
+     * The event holds everything needed to make the call, so it
+     * can be run on another thread without touching the sensor.
+     */
+    struct motion_event {
+        int16_t handler;
+        motion_handler::func function;
+        motion_handler::context_func contextual;
+        void *context;
+
+        vector3<int16_t> gyro;
+        vector3<int16_t> accel;
+        uint_fast64_t timestamp;
+
+        /**
+         * \brief
+         * Call the function of the handler with the data of the event.
+         */
+        void call() const {
+            if (contextual != nullptr) {
+                contextual(gyro, accel, context);
+            } else if (function != nullptr) {
+                function(gyro, accel);
+            }
+        }
+    };
+
+    /**
+     * \brief
+     * Interface for running handler calls somewhere else.
+     * \details
+     * When a sensor has a dispatcher, matching handlers are passed
+     * to it as events instead of being called while processing.
+     */
+    class motion_dispatcher {
+    public:
+        /**
+         * \brief
+         * Take over the given event.
+         * \details
+         * Returns false if the event was dropped.
+         * @param event
+         * @return
+         */
+        virtual bool dispatch(const motion_event &event) = 0;
+    };
+
+    /**
+     * \brief
+     * Table of registered motion handlers.
+     * \details
+     * The handlers are stored densely, so processing them only touches
+     * registered handlers. Every handler gets an id on registration that
+     * stays the same while other handlers are added and removed: a handler
+     * is removed by moving the last handler into its place, and a slot
+     * table maps ids to positions. Free ids are kept in a list threaded
+     * through the slot table, so adding and removing are O(1).
+     *
+     * Use fixed_handler_table for a table with its own storage.
+     */
+    class handler_table {
+    private:
+        motion_handler *handlers;
+        uint16_t *ids;
+        uint16_t *slots;
+        handler_state *states;
+        uint16_t capacity;
+        uint16_t count;
+        uint16_t next_free;
+
+    protected:
+        /**
+         * \brief
+         * Constructor with the storage for the table.
+         * \details
+         * All arrays must hold capacity elements. The capacity
+         * is limited to the range of an id. The table is empty
+         * once clear() is called.
+         * @param handlers
+         * @param ids
+         * @param slots
+         * @param states
+         * @param capacity
+         */
+        handler_table(motion_handler *handlers, uint16_t *ids, uint16_t *slots, handler_state *states,
+                      uint16_t capacity);
+
+    public:
+        /**
+         * \brief
+         * Add a handler to the table.
+         * \details
+         * Returns the id of the handler, or -1 if the table is full.
+         * @param handler
+         * @return
+         */
+        int16_t add(const motion_handler &handler);
+
+        /**
+         * \brief
+         * Remove the handler with the given id.
+         * \details
+         * Returns false if no handler has the given id.
+         * The last handler is moved into the freed position.
+         * @param id
+         * @return
+         */
+        bool remove(int16_t id);
+
+        /**
+         * \brief
+         * Find the handler with the given id.
+         * \details
+         * Returns nullptr if no handler has the given id.
+         * @param id
+         * @return
+         */
+        motion_handler *find(int16_t id);
+
+        /**
+         * \brief
+         * Get the id of the handler at the given position.
+         * @param position
+         * @return
+         */
+        int16_t get_id(uint16_t position) const;
+
+        /**
+         * \brief
+         * Get the state of the handler with the given id.
+         * \details
+         * The state is kept per id, so it stays in place when
+         * the handler is moved. The id must be below the capacity.
+         * @param id
+         * @return
+         */
+        handler_state &get_state(int16_t id);
+
+        /**
+         * \brief
+         * Copy the handlers and ids of the other table.
+         * \details
+         * The states are not copied. Returns false if the
+         * capacities of the tables are not the same.
+         * @param other
+         * @return
+         */
+        bool assign(const handler_table &other);
+
+        /**
+         * \brief
+         * The amount of registered handlers.
+         * @return
+         */
+        uint16_t length() const;
+
+        /**
+         * \brief
+         * The amount of handlers the table can hold.
+         * @return
+         */
+        uint16_t get_capacity() const;
+
+        /**
+         * \brief
+         * Check if no more handlers can be added.
+         * @return
+         */
+        bool is_full() const;
+
+        /**
+         * \brief
+         * Remove all handlers.
+         */
+        void clear();
+
+        motion_handler *begin();
+
+        motion_handler *end();
+    };
+
+    /**
+     * \brief
+     * A handler_table with storage for Capacity handlers.
+     * @tparam Capacity
+     */
+    template<uint16_t Capacity>
+    class fixed_handler_table : public handler_table {
+        static_assert(Capacity > 0 && Capacity <= 0x7FFF, "the capacity must fit in an id");
+
+    private:
+        motion_handler handler_storage[Capacity];
+        uint16_t id_storage[Capacity];
+        uint16_t slot_storage[Capacity];
+        handler_state state_storage[Capacity];
+
+    public:
+        fixed_handler_table()
+                : handler_table(handler_storage, id_storage, slot_storage, state_storage, Capacity) {
+            clear();
+        }
+
+        fixed_handler_table(const fixed_handler_table &) = delete;
+
+        fixed_handler_table &operator=(const fixed_handler_table &) = delete;
+    };
+
+    /**
+     * \brief
+     * A handler table together with the leaves of its handlers.
+     * \details
+     * A sensor processes the handlers of one snapshot at a time. With a
+     * second snapshot, see motion_sensor::use_snapshots(), changes are
+     * made to the snapshot that is not in use, after which it replaces
+     * the current one.
+     *
+     * Use fixed_handler_snapshot for a snapshot with its own table.
+     */
+    class handler_snapshot {
+        friend class motion_sensor;
+
+    private:
+        handler_table *handlers;
+        leaf_table leaves;
+
+        /*
+         * The amount of threads processing the handlers of this snapshot.
+         */
+        std::atomic<uint32_t> readers;
+
+    public:
+        /**
+         * \brief
+         * Constructor with the handler table of the snapshot.
+         * @param table
+         */
+        explicit handler_snapshot(handler_table &table);
+
+        handler_snapshot(const handler_snapshot &) = delete;
+
+        handler_snapshot &operator=(const handler_snapshot &) = delete;
+    };
+
+    /**
+     * \brief
+     * A handler_snapshot with its own table of Capacity handlers.
+     * @tparam Capacity
+     */
+    template<uint16_t Capacity>
+    class fixed_handler_snapshot : public handler_snapshot {
+    private:
+        fixed_handler_table<Capacity> table;
+
+    public:
+        fixed_handler_snapshot() : handler_snapshot(table), table() {}
+    };
+
     /**
      * \brief
      * Motion sensor base class.
      * \details
      * The base class for all motion sensor implementations.
-     * This class also contains the handlers that can be registered.
+     * A sensor that reads the hardware stores its handlers in a snapshot
+     * it owns. A decorator has no storage of its own: the first time a
+     * handler is registered on it, it takes over the storage of its
+     * slave, which is only read from then on. See use_handlers() and
+     * with_handlers for more handlers.
      */
     class motion_sensor {
+    public:
+        /**
+         * \brief
+         * The amount of handlers a sensor stores by default.
+         */
+        constexpr static uint16_t default_handler_count = 8;
+
+        /**
+         * \brief
+         * The amount of samples process_samples() hands to the handlers at once.
+         */
+        constexpr static uint16_t sample_batch = 16;
+
+    private:
+        /*
+         * The handlers and the unique leaves of all registered handlers,
+         * or nullptr if handlers can't be registered. The table of the
+         * primary snapshot also holds the state of every handler, which
+         * is shared by both snapshots.
+         */
+        handler_snapshot *primary;
+        handler_snapshot *spare;
+
+        std::atomic<handler_snapshot *> current;
+        std::atomic_flag updating = ATOMIC_FLAG_INIT;
+
+        /*
+         * The earliest time a handler is due, and whether the handlers
+         * changed since it was computed. Only used by process_handlers().
+         */
+        uint_fast64_t next_tick;
+        std::atomic<bool> rescheduled;
+
+        /*
+         * The interrupt line of the sensor in event driven mode,
+         * or nullptr to read the sensor on every call.
+         */
+        hwlib::pin_in *interrupt;
+
+        /*
+         * The sensor a decorator reads from, whose storage it takes over,
+         * or nullptr for a sensor that stores its own handlers.
+         */
+        motion_sensor *source;
+
+        /*
+         * Take over the storage of the source if this sensor has none.
+         * Only possible while the source has no handlers registered.
+         * Returns whether the sensor has storage.
+         */
+        bool take_handlers();
+
     protected:
         /**
          * \brief
-         * The maximum amount of handlers that can be
-         * registered.
+         * Where matching handlers are sent, or nullptr to call them directly.
+         */
+        motion_dispatcher *dispatcher;
+
+        /**
+         * \brief
+         * Get the current snapshot for processing.
+         * \details
+         * The snapshot is not changed or reused until it is released.
+         * @return
+         */
+        handler_snapshot &acquire_snapshot();
+
+        /**
+         * \brief
+         * Release a snapshot returned by acquire_snapshot().
+         * @param snapshot
+         */
+        void release_snapshot(handler_snapshot &snapshot);
+
+        /**
+         * \brief
+         * Get the snapshot to make changes to.
+         * \details
+         * Without a spare snapshot, this is the current snapshot. Otherwise
+         * it is the other snapshot, once no thread is processing it anymore,
+         * filled with a copy of the current one. Only one update runs at a
+         * time, every call has to be followed by end_update().
+         * @return
+         */
+        handler_snapshot &begin_update();
+
+        /**
+         * \brief
+         * Finish an update, making the changed snapshot current if publish is true.
+         * @param target
+         * @param publish
+         */
+        void end_update(handler_snapshot &target, bool publish);
+
+        /**
+         * \brief
+         * Rebuild the leaf table of the snapshot from its handlers.
+         * \details
+         * Used after a handler is removed, so leaves that are no
+         * longer used are not evaluated anymore.
+         * @param snapshot
+         */
+        void rebind_handlers(handler_snapshot &snapshot);
+
+        /**
+         * \brief
+         * Run the handlers of the snapshot over every sample of the block.
+         * @param snapshot
+         * @param block
+         */
+        void process_block(handler_snapshot &snapshot, const sample_block &block);
+
+        /**
+         * \brief
+         * Run the handlers that are due over a single sample.
+         * @param sample
+         */
+        void process_sample(const motion_sample &sample);
+
+        /**
+         * \brief
+         * Bind the rule of the handler to the leaves and add it to the table.
+         * \details
+         * Returns -1 on failure, otherwise the handler id.
+         * @param prototype
+         * @return
          */
-        constexpr static int8_t handler_count = 8;
+        int16_t add_handler(const motion_handler &prototype);
 
         /**
          * \brief
-         * All motion handlers that are registered.
-         * Check if a spot is empty with motion_handler::is_free().
+         * Constructor with the snapshot to store the handlers in.
+         * \details
+         * For a sensor that reads the hardware. The snapshot is usually
+         * a fixed_handler_snapshot<default_handler_count> member.
+         * @param snapshot
          */
-        motion_handler handlers[handler_count];
+        explicit motion_sensor(handler_snapshot &snapshot);
+
+        /**
+         * \brief
+         * Constructor for a decorator of the given slave.
+         * \details
+         * The decorator takes over the storage of the slave once a
+         * handler is registered on it.
+         * @param slave
+         */
+        explicit motion_sensor(motion_sensor *slave);
 
     public:
+        motion_sensor(const motion_sensor &) = delete;
+
+        motion_sensor &operator=(const motion_sensor &) = delete;
+
         /**
          * \brief
-         * 0 argument constructor.
+         * Store the handlers in the given snapshot.
+         * \details
+         * Replaces the default storage of the sensor. Only possible while
+         * no handlers are registered and no spare snapshot is used,
+         * returns false otherwise. The snapshot must be empty and outlive
+         * its use.
+         *
+         * \code
+         * ipass::fixed_handler_snapshot<64> handlers;
+         * sensor.use_handlers(handlers);
+         * \endcode
+         * @param snapshot
+         * @return
          */
-        motion_sensor();
+        bool use_handlers(handler_snapshot &snapshot);
+
+        /**
+         * \brief
+         * Register and remove handlers without stopping the processing.
+         * \details
+         * Normally handlers are changed in place, so when() and
+         * remove_handler() must not run while another thread calls
+         * process_handlers(). With a spare snapshot, changes are made
+         * to a copy of the handlers, which replaces the current handlers
+         * in a single atomic store. Processing always uses a complete
+         * snapshot and never waits; an update only waits for processing
+         * that still uses the snapshot from before the previous update.
+         *
+         * Only possible while no handlers are registered, returns false
+         * otherwise, or if the sensor has no storage for them. The
+         * table of the spare must be empty and have the same capacity as
+         * the table of the sensor. Handlers should be processed
+         * by a single thread, and on a single core an update must not
+         * interrupt the processing. Leaves of removed temporal rules are
+         * kept until all temporal rules are removed, since their bindings
+         * are shared by both snapshots.
+         *
+         * \code
+         * ipass::fixed_handler_snapshot<ipass::motion_sensor::default_handler_count> spare;
+         * sensor.use_snapshots(spare);
+         * \endcode
+         * @param snapshot
+         * @return
+         */
+        bool use_snapshots(handler_snapshot &snapshot);
+
+        /**
+         * \brief
+         * Send matching handlers to the given dispatcher.
+         * \details
+         * By default, matching handlers are called while processing,
+         * so a slow handler delays the next sample. With a dispatcher,
+         * for example an event_queue drained by a worker_pool, processing
+         * only hands over an event per call. Pass nullptr to call the
+         * handlers directly again.
+         * @param target
+         */
+        void set_dispatcher(motion_dispatcher *target);
+
+        /**
+         * \brief
+         * Only process the handlers when the sensor raises an interrupt.
+         * \details
+         * In event driven mode process_handlers() reads the given pin
+         * first, and returns without any bus traffic while it is low
+         * and has_pending_interrupt() returns false. Otherwise the
+         * interrupt is acknowledged with
+         * acknowledge_interrupt() and a sample is processed. The sensor
+         * has to be set up to raise its interrupt on new data or motion,
+         * and keep the line high until it is acknowledged. Pass nullptr
+         * to read the sensor on every call again.
+         * @param pin
+         */
+        void use_interrupt(hwlib::pin_in *pin);
+
+        /**
+         * \brief
+         * The amount of registered handlers.
+         * @return
+         */
+        uint16_t get_handler_count() const;
+
+        /**
+         * \brief
+         * Get the id of the handler at the given position.
+         * \details
+         * Handlers are kept in registration order until one is removed,
+         * then the last handler takes its position.
+         * @param position
+         * @return
+         */
+        int16_t get_handler_id(uint16_t position) const;
 
         /**
          * \brief
          * Add a rule to to the handlers list.
          * \details
          * Add a rule to to the handlers list.
+         * The rule is compiled into a rule_program on registration,
+         * so the rule tree is not walked when processing handlers.
+         * Leaves that are shared with other handlers are only
+         * evaluated once per sample.
+         * A rule tree that does not fit in a rule_program is evaluated
+         * through motion_rule::match_against() instead, as a single leaf.
+         * If the leaves do not fit in the leaf table, the rule is matched
+         * against the data of every sample by itself instead.
          * If no empty spot is available for the handler, -1 is returned.
-         * Otherwise the handler index is returned.
+         * Otherwise the handler id is returned, which stays valid until
+         * the handler is removed.
          * Use the remove_handler() function to remove a registered handler.
          * Call process_handlers() to process all registered
          * handlers.
+         *
+         * By default the handler is called for every sample the rule matches.
+         * Pass another trigger_mode to only call it when the rule starts
+         * and/or stops matching.
          * @param rule
+         * @param mode
+         * @return
+         */
+        int16_t when(motion_rule &rule, motion_handler::func, trigger_mode mode = trigger_mode::level);
+
+        /**
+         * \brief
+         * Add a compiled rule to the handlers list.
+         * \details
+         * Like when() with a motion_rule, for a rule that is already
+         * compiled, for example by a rule_arena. The sensor keeps its
+         * own copy of the program.
+         * Returns -1 on failure, otherwise the handler id.
+         * @param program
+         * @param mode
          * @return
          */
-        int8_t when(motion_rule &rule, motion_handler::func);
+        int16_t when(const rule_program &program, motion_handler::func, trigger_mode mode = trigger_mode::level);
+
+        /**
+         * \brief
+         * Add a temporal rule to the handlers list.
+         * \details
+         * Add a temporal rule, like a sequence_rule, to the handlers list.
+         * The conditions of the rule share leaves with the other handlers.
+         * The sensor keeps a reference to the rule, since the rule holds
+         * state; the rule must outlive the registration.
+         * Returns -1 on failure, otherwise the handler id.
+         * @param rule
+         * @param mode
+         * @return
+         */
+        int16_t when(temporal_rule &rule, motion_handler::func, trigger_mode mode = trigger_mode::level);
+
+        /**
+         * \brief
+         * Add a rule with a callback that gets a context.
+         * \details
+         * Like when() with a plain function, but the given context is passed
+         * to every call of the function, so the callback can update state
+         * without globals. The context is not copied and must outlive the
+         * registration.
+         *
+         * \code
+         * sensor.when(shaken, [](const auto &, const auto &, void *context) {
+         *     static_cast<device *>(context)->shakes++;
+         * }, &left_hand);
+         * \endcode
+         * @param rule
+         * @param context
+         * @param mode
+         * @return
+         */
+        int16_t when(motion_rule &rule, motion_handler::context_func, void *context,
+                     trigger_mode mode = trigger_mode::level);
+
+        /**
+         * \brief
+         * Add a compiled rule with a callback that gets a context.
+         * @param program
+         * @param context
+         * @param mode
+         * @return
+         */
+        int16_t when(const rule_program &program, motion_handler::context_func, void *context,
+                     trigger_mode mode = trigger_mode::level);
+
+        /**
+         * \brief
+         * Add a temporal rule with a callback that gets a context.
+         * @param rule
+         * @param context
+         * @param mode
+         * @return
+         */
+        int16_t when(temporal_rule &rule, motion_handler::context_func, void *context,
+                     trigger_mode mode = trigger_mode::level);
+
+        /**
+         * \brief
+         * Remove a registered handler from the handlers list.
+         * \details
+         * Remove the handler with the given id from the handlers list.
+         * If no handler has the given id, this function will do nothing.
+         * @param id
+         */
+        void remove_handler(int16_t id);
+
+        /**
+         * \brief
+         * Set the refractory period of a registered handler.
+         * \details
+         * After the handler is called, it is not called again until the
+         * given amount of microseconds has passed, even if its rule keeps
+         * matching. A period of 0 (the default) disables the refractory period.
+         * If no handler has the given id, this function will do nothing.
+         * @param id
+         * @param period
+         */
+        void set_refractory(int16_t id, uint_fast64_t period);
+
+        /**
+         * \brief
+         * Set the evaluation period of a registered handler.
+         * \details
+         * By default a handler is evaluated on every sample. With a period,
+         * in microseconds, it is only evaluated once the period has passed
+         * since its previous evaluation, so a gesture that only needs to be
+         * checked at 10 Hz does not cost anything on the other samples.
+         * When no handler is due, process_handlers() returns before reading
+         * the sensor. Trigger modes compare consecutive evaluations.
+         * If no handler has the given id, this function will do nothing.
+         * @param id
+         * @param period
+         */
+        void set_period(int16_t id, uint_fast64_t period);
 
         /**
          * \brief
-         * Remove a registered index from the handlers list.
+         * The amount of times a handler was evaluated too late.
          * \details
-         * Remove a registered index from the handlers list.
-         * If the index is below 0 or above the maximum handler count,
-         * this function will do nothing.
-         * @param index
+         * An overrun is counted when a whole period passed after the handler
+         * was due, because the sensor was not processed in time. Returns 0
+         * if no handler has the given id. The count is updated by the thread
+         * processing the handlers.
+         * @param id
+         * @return
          */
-        void remove_handler(int8_t index);
+        uint32_t get_overruns(int16_t id);
 
         /**
          * \brief
@@ -178,6 +1003,9 @@ namespace ipass {
         /**
          * \brief
          * Get accelerometer data from the sensor.
+         * \details
+         * The data is in accel_format, Q4.11 g, so the rules can use
+         * the full resolution of the sensor.
          * @return
          */
         virtual vector3<int16_t> get_accel() = 0;
@@ -233,6 +1061,8 @@ namespace ipass {
         /**
          * \brief
          * Get gyroscope data from the sensor.
+         * \details
+         * The data is in gyro_format, Q11.4 degrees per second.
          * @return
          */
         virtual vector3<int16_t> get_gyro() = 0;
@@ -285,11 +1115,132 @@ namespace ipass {
         */
         virtual int16_t get_gyro_z();
 
+        /**
+         * \brief
+         * Get the time at which the sensor data was sampled.
+         * \details
+         * The time is in microseconds and is used by temporal rules.
+         * By default this is the current time from hwlib::now_us().
+         * @return
+         */
+        virtual uint_fast64_t get_timestamp();
+
+        /**
+         * \brief
+         * Get the gyroscope and accelerometer data in one acquisition.
+         * \details
+         * By default this calls get_gyro(), get_accel() and get_timestamp().
+         * Implementations that can read all data in a single transaction
+         * should override this, since process_handlers() only uses this
+         * function to read the sensor. The temperature is 0 if the sensor
+         * does not measure it.
+         * @return
+         */
+        virtual motion_sample get_sample();
+
+        /**
+         * \brief
+         * Read the samples the sensor buffered, up to capacity.
+         * \details
+         * By default this reads a single sample with get_sample().
+         * Sensors with a hardware buffer override this to drain it, and
+         * decorators apply their correction to every sample. Returns the
+         * amount of samples read.
+         * @param samples
+         * @param capacity
+         * @return
+         */
+        virtual uint16_t read_samples(motion_sample *samples, uint16_t capacity);
+
+        /**
+         * \brief
+         * Acknowledge the interrupt of the sensor.
+         * \details
+         * Called by process_handlers() in event driven mode when the
+         * interrupt pin is high. Implementations clear the interrupt
+         * of the sensor here, so the line goes low again, and return
+         * whether there is anything to process. By default this does
+         * nothing and returns true.
+         * @return
+         */
+        virtual bool acknowledge_interrupt();
+
+        /**
+         * \brief
+         * Whether the sensor cleared an interrupt that was not processed yet.
+         * \details
+         * Some sensors clear their interrupt as a side effect of other
+         * reads, for example of a status register shared with a FIFO,
+         * which drops the interrupt line before process_handlers() sees
+         * it. Implementations return true here until the interrupt is
+         * acknowledged with acknowledge_interrupt(). By default this
+         * returns false.
+         * @return
+         */
+        virtual bool has_pending_interrupt();
+
         /**
          * \brief
          * Process all registered motion handlers.
+         * \details
+         * Reads a sample with get_sample(), unless no handler is due
+         * or, in event driven mode, the sensor raised no interrupt.
          */
         virtual void process_handlers();
+
+        /**
+         * \brief
+         * Process all registered motion handlers for the given sample.
+         * \details
+         * For a sample that was already read, so the same data can be
+         * used for other things, like a display, without reading the
+         * sensor again.
+         *
+         * \code
+         * const auto sample = sensor.get_sample();
+         * sensor.process_handlers(sample);
+         * \endcode
+         * @param sample
+         */
+        void process_handlers(const motion_sample &sample);
+
+        /**
+         * \brief
+         * Process all registered motion handlers for a block of samples.
+         * \details
+         * Runs the handlers over every sample of the block, in order, as if
+         * process_handlers() was called once per sample. The leaves are
+         * evaluated for a chunk of samples at once using SIMD compares
+         * where available, which is a lot faster when replaying recorded
+         * data or draining a sensor FIFO.
+         * @param block
+         */
+        void process_handlers(const sample_block &block);
+
+        /**
+         * \brief
+         * Process all registered motion handlers for a span of samples.
+         * \details
+         * Like process_handlers(const sample_block &), for samples that are
+         * stored one after the other with their own timestamp. The samples
+         * are rearranged a chunk at a time, the handlers are looked up once
+         * for the whole span.
+         * @param samples
+         * @param count
+         */
+        void process_handlers(const motion_sample *samples, uint32_t count);
+
+        /**
+         * \brief
+         * Read all buffered samples and run the handlers over them.
+         * \details
+         * The samples are read with read_samples(), sample_batch at a
+         * time, until the sensor has fewer left. On a decorator this
+         * drains the buffer of the sensor it decorates, with the
+         * correction applied. Returns the amount of samples processed.
+         * @return
+         */
+        uint32_t process_samples();
     };
 
     /**
@@ -303,7 +1254,7 @@ namespace ipass {
      */
     class cached_motion_sensor : public motion_sensor {
     protected:
-        vector3<int16_t> gyro, accel;
+        motion_sample sample;
         motion_sensor &slave;
 
     public:
@@ -335,9 +1286,47 @@ namespace ipass {
          */
         vector3<int16_t> get_gyro() override;
 
+        /**
+         * Get the timestamp, will return
+         * the time of the last refresh.
+         * @return
+         */
+        uint_fast64_t get_timestamp() override;
+
+        /**
+         * Get the sample, will return
+         * the cached data.
+         * @return
+         */
+        motion_sample get_sample() override;
+
+        /**
+         * Read the buffered samples, will read them
+         * from the slave and cache the newest one.
+         * @param samples
+         * @param capacity
+         * @return
+         */
+        uint16_t read_samples(motion_sample *samples, uint16_t capacity) override;
+
+        /**
+         * Acknowledge the interrupt, will simply
+         * pass the acknowledgement to the slave.
+         * @return
+         */
+        bool acknowledge_interrupt() override;
+
+        /**
+         * Check for a pending interrupt, will
+         * simply pass the check to the slave.
+         * @return
+         */
+        bool has_pending_interrupt() override;
+
         /**
          * Refresh the gyroscope and accelerometer
-         * data from the implementation.
+         * data from the implementation, with
+         * a single acquisition.
          */
         void refresh();
     };
@@ -345,6 +1334,9 @@ namespace ipass {
     /**
      * \brief
      * Base class for a motion corrected sensor decorator.
+     * \details
+     * The correction is subtracted from the data, and is in the
+     * same format: accel_format or gyro_format.
      */
     class corrected_motion_sensor : public motion_sensor {
     protected:
@@ -367,6 +1359,27 @@ namespace ipass {
          * on the slave.
          */
         void initialize() override;
+
+        /**
+         * Get the timestamp, will simply
+         * pass the timestamp from the slave.
+         * @return
+         */
+        uint_fast64_t get_timestamp() override;
+
+        /**
+         * Acknowledge the interrupt, will simply
+         * pass the acknowledgement to the slave.
+         * @return
+         */
+        bool acknowledge_interrupt() override;
+
+        /**
+         * Check for a pending interrupt, will
+         * simply pass the check to the slave.
+         * @return
+         */
+        bool has_pending_interrupt() override;
     };
 
     /**
@@ -396,6 +1409,22 @@ namespace ipass {
          * @return
          */
         vector3<int16_t> get_gyro() override;
+
+        /**
+         * Get sample implementation, will
+         * apply correction to the gyro data.
+         * @return
+         */
+        motion_sample get_sample() override;
+
+        /**
+         * Read samples implementation, will
+         * apply correction to the gyro data.
+         * @param samples
+         * @param capacity
+         * @return
+         */
+        uint16_t read_samples(motion_sample *samples, uint16_t capacity) override;
     };
 
     /**
@@ -425,6 +1454,53 @@ namespace ipass {
         * @return
         */
         vector3<int16_t> get_gyro() override;
+
+        /**
+         * Get sample implementation, will
+         * apply correction to the accel data.
+         * @return
+         */
+        motion_sample get_sample() override;
+
+        /**
+         * Read samples implementation, will
+         * apply correction to the accel data.
+         * @param samples
+         * @param capacity
+         * @return
+         */
+        uint16_t read_samples(motion_sample *samples, uint16_t capacity) override;
+    };
+
+    /**
+     * \brief
+     * A sensor together with the storage for Capacity handlers.
+     * \details
+     * For a sensor that needs more or fewer handlers than the default
+     * storage of its slave, or a decorator whose slave keeps processing
+     * handlers of its own. The arguments are passed to the constructor
+     * of the sensor.
+     *
+     * \code
+     * mpu6050 mpu(bus);
+     * ipass::with_handlers<ipass::gyro_corrected_motion_sensor> sensor(mpu, correction);
+     *
+     * sensor.when(tilted, handler);
+     * \endcode
+     * @tparam Sensor
+     * @tparam Capacity
+     */
+    template<typename Sensor, uint16_t Capacity = motion_sensor::default_handler_count>
+    class with_handlers : public Sensor {
+    private:
+        fixed_handler_snapshot<Capacity> storage;
+
+    public:
+        template<typename... Args>
+        explicit with_handlers(Args &&... args)
+                : Sensor(std::forward<Args>(args)...), storage() {
+            this->use_handlers(storage);
+        }
     };
 }
 
@@ -0,0 +1,201 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "rule_arena.hpp"
+
+ipass::rule_arena::rule_arena(ipass::rule_node *nodes, uint16_t capacity)
+        : nodes(nodes), capacity(capacity > 0x7FFF ? 0x7FFF : capacity), size(0) {}
+
+int16_t ipass::rule_arena::push(const ipass::rule_node &node) {
+    if (size >= capacity) {
+        return -1;
+    }
+
+    nodes[size] = node;
+    return int16_t(size++);
+}
+
+bool ipass::rule_arena::contains(int16_t handle) const {
+    return handle >= 0 && uint16_t(handle) < size;
+}
+
+int16_t ipass::rule_arena::leaf(ipass::rule_source source, ipass::motion gesture, int16_t threshold) {
+    rule_node node = {};
+    node.kind = rule_node_kind::leaf;
+    node.leaf.source = source;
+    node.leaf.gesture = uint8_t(gesture);
+    node.leaf.threshold = threshold;
+
+    return push(node);
+}
+
+int16_t ipass::rule_arena::gyro(ipass::motion gesture, int16_t threshold) {
+    return leaf(rule_source::gyro, gesture, threshold);
+}
+
+int16_t ipass::rule_arena::accel(ipass::motion gesture, int16_t threshold) {
+    return leaf(rule_source::accel, gesture, threshold);
+}
+
+int16_t ipass::rule_arena::all(int16_t lhs, int16_t rhs) {
+    if (!contains(lhs) || !contains(rhs)) {
+        return -1;
+    }
+
+    rule_node node = {};
+    node.kind = rule_node_kind::all;
+    node.branch.lhs = uint16_t(lhs);
+    node.branch.rhs = uint16_t(rhs);
+
+    return push(node);
+}
+
+int16_t ipass::rule_arena::any(int16_t lhs, int16_t rhs) {
+    if (!contains(lhs) || !contains(rhs)) {
+        return -1;
+    }
+
+    rule_node node = {};
+    node.kind = rule_node_kind::any;
+    node.branch.lhs = uint16_t(lhs);
+    node.branch.rhs = uint16_t(rhs);
+
+    return push(node);
+}
+
+int16_t ipass::rule_arena::invert(int16_t operand) {
+    if (!contains(operand)) {
+        return -1;
+    }
+
+    rule_node node = {};
+    node.kind = rule_node_kind::invert;
+    node.branch.lhs = uint16_t(operand);
+    node.branch.rhs = uint16_t(operand);
+
+    return push(node);
+}
+
+const ipass::rule_node &ipass::rule_arena::operator[](int16_t handle) const {
+    return nodes[handle];
+}
+
+uint16_t ipass::rule_arena::length() const {
+    return size;
+}
+
+uint16_t ipass::rule_arena::get_capacity() const {
+    return capacity;
+}
+
+uint16_t ipass::rule_arena::mark() const {
+    return size;
+}
+
+void ipass::rule_arena::rewind(uint16_t mark) {
+    if (mark < size) {
+        size = mark;
+    }
+}
+
+void ipass::rule_arena::clear() {
+    size = 0;
+}
+
+bool ipass::rule_arena::evaluate(uint16_t index, const vector3<int16_t> &gyro,
+                                 const vector3<int16_t> &accel) const {
+    const rule_node &node = nodes[index];
+
+    switch (node.kind) {
+        case rule_node_kind::leaf: {
+            const vector3<int16_t> &data = node.leaf.source == rule_source::gyro ? gyro : accel;
+            const auto gesture = motion(node.leaf.gesture);
+
+            if (gesture == motion::none) {
+                return true;
+            }
+
+            const uint8_t axis = motion_axis(gesture);
+            const int16_t value = axis == 0 ? data.x : axis == 1 ? data.y : data.z;
+
+            switch (motion_comparison(gesture)) {
+                case 0:
+                    return value > node.leaf.threshold;
+
+                case 1:
+                    return value == node.leaf.threshold;
+
+                default:
+                    return value < node.leaf.threshold;
+            }
+        }
+
+        case rule_node_kind::all:
+            return evaluate(node.branch.lhs, gyro, accel)
+                   && evaluate(node.branch.rhs, gyro, accel);
+
+        case rule_node_kind::any:
+            return evaluate(node.branch.lhs, gyro, accel)
+                   || evaluate(node.branch.rhs, gyro, accel);
+
+        case rule_node_kind::invert:
+            return !evaluate(node.branch.lhs, gyro, accel);
+    }
+
+    return false;
+}
+
+bool ipass::rule_arena::lower(uint16_t index, ipass::rule_program &program) const {
+    const rule_node &node = nodes[index];
+
+    switch (node.kind) {
+        case rule_node_kind::leaf:
+            return program.push_leaf(node.leaf.source, motion(node.leaf.gesture), node.leaf.threshold);
+
+        case rule_node_kind::all:
+            return lower(node.branch.lhs, program)
+                   && lower(node.branch.rhs, program)
+                   && program.push(rule_opcode::combine);
+
+        case rule_node_kind::any:
+            return lower(node.branch.lhs, program)
+                   && lower(node.branch.rhs, program)
+                   && program.push(rule_opcode::either);
+
+        case rule_node_kind::invert:
+            return lower(node.branch.lhs, program)
+                   && program.push(rule_opcode::invert);
+    }
+
+    return false;
+}
+
+bool ipass::rule_arena::match_against(int16_t handle, const vector3<int16_t> &gyro,
+                                      const vector3<int16_t> &accel) const {
+    return contains(handle) && evaluate(uint16_t(handle), gyro, accel);
+}
+
+bool ipass::rule_arena::compile(int16_t handle, ipass::rule_program &program) const {
+    return contains(handle) && lower(uint16_t(handle), program);
+}
+
+ipass::arena_rule ipass::rule_arena::get(int16_t handle) const {
+    return arena_rule(*this, handle);
+}
+
+ipass::arena_rule::arena_rule(const ipass::rule_arena &arena, int16_t handle)
+        : motion_rule(motion::none, 0), arena(arena), handle(handle) {}
+
+bool ipass::arena_rule::match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    return arena.match_against(handle, gyro, accel);
+}
+
+bool ipass::arena_rule::compile(ipass::rule_program &program) const {
+    return arena.compile(handle, program);
+}
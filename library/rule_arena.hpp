@@ -0,0 +1,307 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_RULE_ARENA_HPP
+#define IPASS_RULE_ARENA_HPP
+
+#include <cstdint>
+#include "vector3.hpp"
+#include "motion_rule.hpp"
+#include "rule_program.hpp"
+
+namespace ipass {
+
+    /**
+     * \brief
+     * The kind of a node in a rule_arena.
+     */
+    enum class rule_node_kind : uint8_t {
+        leaf,
+        all,
+        any,
+        invert
+    };
+
+    /**
+     * \brief
+     * A node in a rule_arena.
+     * \details
+     * A leaf compares one axis of a source against a threshold, the
+     * other kinds refer to their operands by index. The operands of
+     * a node always have a lower index than the node itself.
+     */
+    struct rule_node {
+        rule_node_kind kind;
+
+        union {
+            struct {
+                rule_source source;
+                uint8_t gesture;
+                int16_t threshold;
+            } leaf;
+
+            struct {
+                uint16_t lhs;
+                uint16_t rhs;
+            } branch;
+        };
+    };
+
+    class arena_rule;
+
+    /**
+     * \brief
+     * Fixed capacity storage for rule trees.
+     * \details
+     * The combinators in motion_rule.hpp hold references to their
+     * operands, so every part of a rule has to be a named object that
+     * outlives its use. A rule arena owns all nodes instead: they are
+     * stored in a single array, and rules are referred to by a handle,
+     * the index of their root node. Failures are reported as a handle
+     * of -1, and an operation on a handle of -1 returns -1 as well, so
+     * a whole tree can be built before checking the result.
+     *
+     * Operands are always created before the node using them, so a rule
+     * built bottom up occupies a contiguous range of nodes, and nodes can
+     * be shared between rules. There is no heap allocation: rules are
+     * torn down by rewinding the arena to an earlier mark, which drops
+     * every node created after it, or by clearing the arena.
+     *
+     * Use fixed_rule_arena for an arena with its own storage.
+     *
+     * \code
+     * ipass::fixed_rule_arena<32> arena;
+     *
+     * auto backwards = arena.gyro(ipass::motion::y_less_then, ipass::gyro_format::from_int(-150));
+     * auto flat = arena.accel(ipass::motion::z_greater_then, ipass::accel_format::from_ratio(9, 10));
+     * auto rule = arena.all(backwards, arena.invert(flat));
+     *
+     * ipass::rule_program program;
+     * arena.compile(rule, program);
+     * sensor.when(program, tilted_backwards);
+     * \endcode
+     */
+    class rule_arena {
+    private:
+        rule_node *nodes;
+        uint16_t capacity;
+        uint16_t size;
+
+        int16_t push(const rule_node &node);
+
+        bool contains(int16_t handle) const;
+
+        bool evaluate(uint16_t index, const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const;
+
+        bool lower(uint16_t index, rule_program &program) const;
+
+    protected:
+        /**
+         * \brief
+         * Constructor with the storage for the nodes.
+         * \details
+         * The capacity is limited to the range of a handle.
+         * @param nodes
+         * @param capacity
+         */
+        rule_arena(rule_node *nodes, uint16_t capacity);
+
+    public:
+        /**
+         * \brief
+         * Add a leaf comparing one axis of the source against the threshold.
+         * @param source
+         * @param gesture
+         * @param threshold
+         * @return
+         */
+        int16_t leaf(rule_source source, motion gesture, int16_t threshold);
+
+        /**
+         * \brief
+         * Add a leaf on the gyroscope data.
+         * @param gesture
+         * @param threshold
+         * @return
+         */
+        int16_t gyro(motion gesture, int16_t threshold);
+
+        /**
+         * \brief
+         * Add a leaf on the accelerometer data.
+         * @param gesture
+         * @param threshold
+         * @return
+         */
+        int16_t accel(motion gesture, int16_t threshold);
+
+        /**
+         * \brief
+         * Add a rule that matches if both rules match.
+         * @param lhs
+         * @param rhs
+         * @return
+         */
+        int16_t all(int16_t lhs, int16_t rhs);
+
+        /**
+         * \brief
+         * Add a rule that matches if either rule matches.
+         * @param lhs
+         * @param rhs
+         * @return
+         */
+        int16_t any(int16_t lhs, int16_t rhs);
+
+        /**
+         * \brief
+         * Add a rule that matches if the rule does not match.
+         * @param operand
+         * @return
+         */
+        int16_t invert(int16_t operand);
+
+        /**
+         * \brief
+         * Access the node of the given handle.
+         * @param handle
+         * @return
+         */
+        const rule_node &operator[](int16_t handle) const;
+
+        /**
+         * \brief
+         * The amount of nodes in the arena.
+         * @return
+         */
+        uint16_t length() const;
+
+        /**
+         * \brief
+         * The amount of nodes the arena can hold.
+         * @return
+         */
+        uint16_t get_capacity() const;
+
+        /**
+         * \brief
+         * Get a mark to rewind the arena to.
+         * @return
+         */
+        uint16_t mark() const;
+
+        /**
+         * \brief
+         * Remove every node created after the mark was taken.
+         * \details
+         * Handles to the removed nodes become invalid.
+         * @param mark
+         */
+        void rewind(uint16_t mark);
+
+        /**
+         * \brief
+         * Remove all nodes.
+         */
+        void clear();
+
+        /**
+         * \brief
+         * Match the rule with the given handle against the data.
+         * \details
+         * An invalid handle never matches.
+         * @param handle
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        bool match_against(int16_t handle, const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const;
+
+        /**
+         * \brief
+         * Lower the rule with the given handle into the program.
+         * \details
+         * Returns false if the handle is invalid or the program is full.
+         * The program does not refer to the arena.
+         * @param handle
+         * @param program
+         * @return
+         */
+        bool compile(int16_t handle, rule_program &program) const;
+
+        /**
+         * \brief
+         * Wrap the rule with the given handle in a motion_rule.
+         * \details
+         * The result refers to the arena, but is only needed while
+         * registering or compiling the rule.
+         * @param handle
+         * @return
+         */
+        arena_rule get(int16_t handle) const;
+    };
+
+    /**
+     * \brief
+     * A rule in a rule_arena, used as motion_rule.
+     */
+    class arena_rule : public motion_rule {
+    private:
+        const rule_arena &arena;
+        int16_t handle;
+
+    public:
+        /**
+         * \brief
+         * Constructor with the arena and the handle of the rule.
+         * @param arena
+         * @param handle
+         */
+        arena_rule(const rule_arena &arena, int16_t handle);
+
+        /**
+         * \brief
+         * Will match the given data against the rule in the arena.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const override;
+
+        /**
+         * \brief
+         * Lower the rule in the arena into the program.
+         * @param program
+         * @return
+         */
+        bool compile(rule_program &program) const override;
+    };
+
+    /**
+     * \brief
+     * A rule_arena with storage for Capacity nodes.
+     * @tparam Capacity
+     */
+    template<uint16_t Capacity>
+    class fixed_rule_arena : public rule_arena {
+        static_assert(Capacity > 0 && Capacity <= 0x7FFF, "the capacity must fit in a handle");
+
+    private:
+        rule_node storage[Capacity];
+
+    public:
+        fixed_rule_arena() : rule_arena(storage, Capacity), storage() {}
+
+        fixed_rule_arena(const fixed_rule_arena &) = delete;
+
+        fixed_rule_arena &operator=(const fixed_rule_arena &) = delete;
+    };
+}
+
+#endif //IPASS_RULE_ARENA_HPP
@@ -0,0 +1,469 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "rule_parser.hpp"
+
+namespace {
+    bool is_identifier(const char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+    }
+
+    bool same(const ipass::rule_node &lhs, const ipass::rule_node &rhs) {
+        if (lhs.kind != rhs.kind) {
+            return false;
+        }
+
+        if (lhs.kind == ipass::rule_node_kind::leaf) {
+            return lhs.leaf.source == rhs.leaf.source
+                   && lhs.leaf.gesture == rhs.leaf.gesture
+                   && lhs.leaf.threshold == rhs.leaf.threshold;
+        }
+
+        return lhs.branch.lhs == rhs.branch.lhs && lhs.branch.rhs == rhs.branch.rhs;
+    }
+}
+
+ipass::rule_parser::rule_parser(ipass::rule_arena &arena)
+        : arena(arena), text(nullptr), position(nullptr) {}
+
+void ipass::rule_parser::skip_space() {
+    while (*position == ' ' || *position == '\t' || *position == '\n' || *position == '\r') {
+        position++;
+    }
+}
+
+bool ipass::rule_parser::accept(const char *token) {
+    skip_space();
+
+    uint8_t length = 0;
+
+    while (token[length] != '\0') {
+        if (position[length] != token[length]) {
+            return false;
+        }
+
+        length++;
+    }
+
+    position += length;
+    return true;
+}
+
+bool ipass::rule_parser::accept_word(const char *word) {
+    const char *start = position;
+
+    if (!accept(word) || is_identifier(*position)) {
+        position = start;
+        return false;
+    }
+
+    return true;
+}
+
+bool ipass::rule_parser::parse_number(number &written) {
+    skip_space();
+
+    const bool negative = *position == '-';
+
+    if (negative) {
+        position++;
+    }
+
+    if (*position < '0' || *position > '9') {
+        return false;
+    }
+
+    written = {0, 1, number::none};
+
+    while (*position >= '0' && *position <= '9') {
+        // Anything this large is out of range for every axis anyway
+        if (written.value < 1000000) {
+            written.value = written.value * 10 + (*position - '0');
+        }
+
+        position++;
+    }
+
+    if (*position == '.' && position[1] >= '0' && position[1] <= '9') {
+        position++;
+
+        while (*position >= '0' && *position <= '9') {
+            // Digits beyond the resolution of the formats are dropped
+            if (written.divisor < 10000 && written.value < 1000000) {
+                written.value = written.value * 10 + (*position - '0');
+                written.divisor *= 10;
+            }
+
+            position++;
+        }
+    }
+
+    if (negative) {
+        written.value = -written.value;
+    }
+
+    // An optional unit converts the number to the format of the axis
+    if (accept_word("g")) {
+        written.unit = number::g;
+    } else if (accept_word("dps")) {
+        written.unit = number::dps;
+    } else if (is_identifier(*position)) {
+        return false;
+    }
+
+    // Without a unit the number is in the format of the axis, which has no fractions
+    return written.unit != number::none || written.divisor == 1;
+}
+
+bool ipass::rule_parser::to_threshold(const number &written, rule_source source, int32_t &threshold) {
+    switch (written.unit) {
+        case number::g:
+            if (source != rule_source::accel) {
+                return false;
+            }
+
+            threshold = accel_format::scale(written.value, written.divisor);
+            return true;
+
+        case number::dps:
+            if (source != rule_source::gyro) {
+                return false;
+            }
+
+            threshold = gyro_format::scale(written.value, written.divisor);
+            return true;
+
+        default:
+            threshold = written.value;
+            return true;
+    }
+}
+
+bool ipass::rule_parser::parse_operator(char &comparison, bool mirrored) {
+    // Less or equal and greater or equal are stored as l and g
+    if (accept("<=")) {
+        comparison = mirrored ? 'g' : 'l';
+    } else if (accept(">=")) {
+        comparison = mirrored ? 'l' : 'g';
+    } else if (accept("==")) {
+        comparison = '=';
+    } else if (accept("!=")) {
+        comparison = '!';
+    } else if (accept("<")) {
+        comparison = mirrored ? '>' : '<';
+    } else if (accept(">")) {
+        comparison = mirrored ? '<' : '>';
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+ipass::rule_parser::term ipass::rule_parser::add(const ipass::rule_node &node) {
+    // Reuse an identical node, so shared sub-expressions are only evaluated once
+    for (uint16_t i = 0; i < arena.length(); i++) {
+        if (same(arena[int16_t(i)], node)) {
+            return {term::node, int16_t(i), false};
+        }
+    }
+
+    int16_t handle;
+
+    switch (node.kind) {
+        case rule_node_kind::leaf:
+            handle = arena.leaf(node.leaf.source, motion(node.leaf.gesture), node.leaf.threshold);
+            break;
+
+        case rule_node_kind::all:
+            handle = arena.all(int16_t(node.branch.lhs), int16_t(node.branch.rhs));
+            break;
+
+        case rule_node_kind::any:
+            handle = arena.any(int16_t(node.branch.lhs), int16_t(node.branch.rhs));
+            break;
+
+        default:
+            handle = arena.invert(int16_t(node.branch.lhs));
+            break;
+    }
+
+    if (handle < 0) {
+        return {term::error, -1, false};
+    }
+
+    return {term::node, handle, false};
+}
+
+ipass::rule_parser::term ipass::rule_parser::make_leaf(ipass::rule_source source, uint8_t axis,
+                                                       char comparison, int32_t threshold) {
+    // Rewrite everything to the three comparisons of a leaf
+    switch (comparison) {
+        case 'l':
+            return make_leaf(source, axis, '<', threshold + 1);
+
+        case 'g':
+            return make_leaf(source, axis, '>', threshold - 1);
+
+        case '!': {
+            const uint16_t mark = arena.mark();
+            return make_invert(make_leaf(source, axis, '=', threshold), mark);
+        }
+
+        default:
+            break;
+    }
+
+    // Comparisons against values outside of the range of an axis are constant
+    if (threshold > INT16_MAX || threshold < INT16_MIN
+        || (comparison == '<' && threshold == INT16_MIN)
+        || (comparison == '>' && threshold == INT16_MAX)) {
+        const bool value = comparison == '<' ? threshold > INT16_MAX
+                           : comparison == '>' && threshold < INT16_MIN;
+
+        return {term::constant, -1, value};
+    }
+
+    rule_node node = {};
+    node.kind = rule_node_kind::leaf;
+    node.leaf.source = source;
+    node.leaf.gesture = uint8_t(make_motion(axis, comparison == '>' ? 0 : comparison == '=' ? 1 : 2));
+    node.leaf.threshold = int16_t(threshold);
+
+    return add(node);
+}
+
+ipass::rule_parser::term ipass::rule_parser::make_invert(const term &operand, uint16_t mark) {
+    if (operand.kind != term::node) {
+        return {operand.kind, -1, !operand.value};
+    }
+
+    // Remove double negations
+    const rule_node &inner = arena[operand.handle];
+
+    if (inner.kind == rule_node_kind::invert) {
+        const auto handle = int16_t(inner.branch.lhs);
+
+        // Drop the inner inverse if it was only built for this expression
+        if (operand.handle >= mark && operand.handle == arena.length() - 1) {
+            arena.rewind(uint16_t(operand.handle));
+        }
+
+        return {term::node, handle, false};
+    }
+
+    rule_node node = {};
+    node.kind = rule_node_kind::invert;
+    node.branch.lhs = uint16_t(operand.handle);
+    node.branch.rhs = uint16_t(operand.handle);
+
+    return add(node);
+}
+
+ipass::rule_parser::term ipass::rule_parser::make_branch(ipass::rule_node_kind kind, const term &lhs,
+                                                         const term &rhs, uint16_t mark) {
+    if (lhs.kind == term::error || rhs.kind == term::error) {
+        return {term::error, -1, false};
+    }
+
+    // The value that decides the result on its own: false for all, true for any
+    const bool decisive = kind == rule_node_kind::any;
+
+    if ((lhs.kind == term::constant && lhs.value == decisive)
+        || (rhs.kind == term::constant && rhs.value == decisive)) {
+        arena.rewind(mark);
+        return {term::constant, -1, decisive};
+    }
+
+    if (lhs.kind == term::constant) {
+        return rhs;
+    }
+
+    if (rhs.kind == term::constant) {
+        return lhs;
+    }
+
+    if (lhs.handle == rhs.handle) {
+        return lhs;
+    }
+
+    // A rule combined with its own inverse
+    const rule_node &left = arena[lhs.handle];
+    const rule_node &right = arena[rhs.handle];
+
+    if ((left.kind == rule_node_kind::invert && left.branch.lhs == uint16_t(rhs.handle))
+        || (right.kind == rule_node_kind::invert && right.branch.lhs == uint16_t(lhs.handle))) {
+        arena.rewind(mark);
+        return {term::constant, -1, decisive};
+    }
+
+    // Both operators are commutative, order the operands so a && b and b && a are the same node
+    rule_node node = {};
+    node.kind = kind;
+    node.branch.lhs = uint16_t(lhs.handle < rhs.handle ? lhs.handle : rhs.handle);
+    node.branch.rhs = uint16_t(lhs.handle < rhs.handle ? rhs.handle : lhs.handle);
+
+    return add(node);
+}
+
+ipass::rule_parser::term ipass::rule_parser::parse_comparison() {
+    const term error = {term::error, -1, false};
+
+    number written = {0, 1, number::none};
+    int32_t threshold = 0;
+    char comparison = '\0';
+
+    skip_space();
+
+    // With the number on the left, the operator is mirrored
+    const bool swapped = *position == '-' || (*position >= '0' && *position <= '9');
+
+    if (swapped && (!parse_number(written) || !parse_operator(comparison, true))) {
+        return error;
+    }
+
+    rule_source source;
+
+    if (accept_word("gyro")) {
+        source = rule_source::gyro;
+    } else if (accept_word("accel")) {
+        source = rule_source::accel;
+    } else {
+        return error;
+    }
+
+    if (!accept(".")) {
+        return error;
+    }
+
+    uint8_t axis;
+
+    if (accept_word("x")) {
+        axis = 0;
+    } else if (accept_word("y")) {
+        axis = 1;
+    } else if (accept_word("z")) {
+        axis = 2;
+    } else {
+        return error;
+    }
+
+    if (!swapped && (!parse_operator(comparison, false) || !parse_number(written))) {
+        return error;
+    }
+
+    if (!to_threshold(written, source, threshold)) {
+        return error;
+    }
+
+    return make_leaf(source, axis, comparison, threshold);
+}
+
+ipass::rule_parser::term ipass::rule_parser::parse_primary() {
+    if (accept("(")) {
+        const term inner = parse_or();
+
+        if (inner.kind == term::error || !accept(")")) {
+            return {term::error, -1, false};
+        }
+
+        return inner;
+    }
+
+    if (accept_word("true")) {
+        return {term::constant, -1, true};
+    }
+
+    if (accept_word("false")) {
+        return {term::constant, -1, false};
+    }
+
+    return parse_comparison();
+}
+
+ipass::rule_parser::term ipass::rule_parser::parse_unary() {
+    if (accept("!")) {
+        const uint16_t mark = arena.mark();
+        const term operand = parse_unary();
+
+        if (operand.kind == term::error) {
+            return operand;
+        }
+
+        return make_invert(operand, mark);
+    }
+
+    return parse_primary();
+}
+
+ipass::rule_parser::term ipass::rule_parser::parse_and() {
+    const uint16_t mark = arena.mark();
+    term result = parse_unary();
+
+    while (result.kind != term::error && accept("&&")) {
+        result = make_branch(rule_node_kind::all, result, parse_unary(), mark);
+    }
+
+    return result;
+}
+
+ipass::rule_parser::term ipass::rule_parser::parse_or() {
+    const uint16_t mark = arena.mark();
+    term result = parse_and();
+
+    while (result.kind != term::error && accept("||")) {
+        result = make_branch(rule_node_kind::any, result, parse_and(), mark);
+    }
+
+    return result;
+}
+
+int16_t ipass::rule_parser::parse(const char *expression) {
+    if (expression == nullptr) {
+        return -1;
+    }
+
+    text = expression;
+    position = expression;
+
+    const uint16_t mark = arena.mark();
+    term result = parse_or();
+
+    skip_space();
+
+    if (result.kind != term::error && *position != '\0') {
+        result.kind = term::error;
+    }
+
+    if (result.kind == term::constant) {
+        // A constant rule still needs a node: always, or its inverse
+        rule_node always = {};
+        always.kind = rule_node_kind::leaf;
+        always.leaf.source = rule_source::gyro;
+        always.leaf.gesture = uint8_t(motion::none);
+
+        const bool value = result.value;
+        result = add(always);
+
+        if (!value) {
+            result = make_invert(result, mark);
+        }
+    }
+
+    if (result.kind == term::error) {
+        arena.rewind(mark);
+        return -1;
+    }
+
+    return result.handle;
+}
+
+uint16_t ipass::rule_parser::get_error() const {
+    return uint16_t(position - text);
+}
@@ -0,0 +1,147 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_RULE_PARSER_HPP
+#define IPASS_RULE_PARSER_HPP
+
+#include <cstdint>
+#include "fixed_point.hpp"
+#include "rule_arena.hpp"
+
+namespace ipass {
+
+    /**
+     * \brief
+     * Parser for rules written as text.
+     * \details
+     * Rules are written as expressions on the axes of the sensor:
+     *
+     * \code
+     * gyro.y < -150 dps && !(accel.z > 0.9 g)
+     * \endcode
+     *
+     * A comparison is a source (gyro or accel), an axis (x, y or z), one
+     * of <, <=, ==, !=, >= or >, and a number; the number may also be
+     * on the left. A number with a unit, g for accel or dps for gyro, may
+     * have decimals and is converted to accel_format or gyro_format. A
+     * number without a unit is an integer in the format of the axis.
+     * Comparisons are combined with !, && and ||, in order of precedence,
+     * and grouped with parentheses. The constants true and false are
+     * allowed as well.
+     *
+     * The expression is added to a rule_arena. While parsing, constants
+     * are folded (a comparison that can't fail because of the range of an
+     * axis is a constant too) and every node is looked up in the arena
+     * before it is added, so sub-expressions that occur more than once,
+     * in this rule or in rules parsed earlier, share their nodes.
+     *
+     * \code
+     * ipass::fixed_rule_arena<64> arena;
+     * ipass::rule_parser parser(arena);
+     *
+     * auto rule = arena.get(parser.parse("gyro.y < -150 dps && !(accel.z > 0.9 g)"));
+     * sensor.when(rule, tilted_backwards);
+     * \endcode
+     */
+    class rule_parser {
+    private:
+        /*
+         * The result of parsing part of an expression: a node in the
+         * arena, a constant that did not need any nodes, or an error.
+         */
+        struct term {
+            enum : uint8_t {
+                node,
+                constant,
+                error
+            } kind;
+
+            int16_t handle;
+            bool value;
+        };
+
+        /*
+         * A number as written: value / divisor, in the unit.
+         */
+        struct number {
+            int32_t value;
+            int32_t divisor;
+
+            enum : uint8_t {
+                none,
+                g,
+                dps
+            } unit;
+        };
+
+        rule_arena &arena;
+        const char *text;
+        const char *position;
+
+        void skip_space();
+
+        bool accept(const char *token);
+
+        bool accept_word(const char *word);
+
+        bool parse_number(number &written);
+
+        static bool to_threshold(const number &written, rule_source source, int32_t &threshold);
+
+        bool parse_operator(char &comparison, bool mirrored);
+
+        term add(const rule_node &node);
+
+        term make_leaf(rule_source source, uint8_t axis, char comparison, int32_t threshold);
+
+        term make_invert(const term &operand, uint16_t mark);
+
+        term make_branch(rule_node_kind kind, const term &lhs, const term &rhs, uint16_t mark);
+
+        term parse_comparison();
+
+        term parse_primary();
+
+        term parse_unary();
+
+        term parse_and();
+
+        term parse_or();
+
+    public:
+        /**
+         * \brief
+         * Constructor with the arena to add the rules to.
+         * @param arena
+         */
+        explicit rule_parser(rule_arena &arena);
+
+        /**
+         * \brief
+         * Parse the given expression into the arena.
+         * \details
+         * Returns the handle of the rule, or -1 if the expression is
+         * invalid or the arena is full. On failure the nodes added
+         * for the expression are removed again, and get_error()
+         * returns where parsing stopped.
+         * @param expression
+         * @return
+         */
+        int16_t parse(const char *expression);
+
+        /**
+         * \brief
+         * The offset in the expression where the last parse failed.
+         * @return
+         */
+        uint16_t get_error() const;
+    };
+}
+
+#endif //IPASS_RULE_PARSER_HPP
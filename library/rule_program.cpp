@@ -0,0 +1,295 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "rule_program.hpp"
+#include "leaf_table.hpp"
+
+ipass::rule_program::rule_program()
+        : instructions(), calls(), size(0), call_count(0),
+          mask(), expected(), conjunction(false) {}
+
+bool ipass::rule_program::push_leaf(ipass::rule_source source, ipass::motion gesture, int16_t threshold) {
+    if (size >= max_size) {
+        return false;
+    }
+
+    if (gesture == motion::none) {
+        instructions[size++] = {rule_opcode::always, source, 0, 0, 0};
+        return true;
+    }
+
+    // The leaf opcodes are in the same order as the comparisons
+    const auto opcode = rule_opcode(uint8_t(rule_opcode::greater_then) + motion_comparison(gesture));
+
+    instructions[size++] = {opcode, source, motion_axis(gesture), threshold, 0};
+    return true;
+}
+
+bool ipass::rule_program::push(ipass::rule_opcode opcode) {
+    if (size >= max_size) {
+        return false;
+    }
+
+    instructions[size++] = {opcode, rule_source::gyro, 0, 0, 0};
+    return true;
+}
+
+bool ipass::rule_program::push_call(const ipass::motion_rule &rule) {
+    if (size >= max_size || call_count >= max_calls) {
+        return false;
+    }
+
+    calls[call_count] = &rule;
+    instructions[size++] = {rule_opcode::call, rule_source::gyro, 0, int16_t(call_count++), 0};
+    return true;
+}
+
+void ipass::rule_program::clear() {
+    size = 0;
+    call_count = 0;
+    conjunction = false;
+}
+
+bool ipass::rule_program::empty() const {
+    return size == 0;
+}
+
+uint8_t ipass::rule_program::length() const {
+    return size;
+}
+
+const ipass::rule_instruction &ipass::rule_program::operator[](uint8_t index) const {
+    return instructions[index];
+}
+
+bool ipass::rule_program::match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    const int16_t *sources[] = {gyro.data, accel.data};
+
+    /*
+     * Intermediate results are kept as a stack of bits,
+     * the lowest bit being the top of the stack.
+     */
+    uint32_t stack = 0;
+
+    for (uint8_t i = 0; i < size; i++) {
+        const auto &instruction = instructions[i];
+        const int16_t value = sources[uint8_t(instruction.source)][instruction.axis];
+
+        switch (instruction.opcode) {
+            case rule_opcode::always:
+                stack = (stack << 1) | 1u;
+                break;
+
+            case rule_opcode::greater_then:
+                stack = (stack << 1) | uint32_t(value > instruction.threshold);
+                break;
+
+            case rule_opcode::equal_to:
+                stack = (stack << 1) | uint32_t(value == instruction.threshold);
+                break;
+
+            case rule_opcode::less_then:
+                stack = (stack << 1) | uint32_t(value < instruction.threshold);
+                break;
+
+            case rule_opcode::invert:
+                stack ^= 1u;
+                break;
+
+            case rule_opcode::combine:
+                stack = (stack >> 1) & (stack | ~1u);
+                break;
+
+            case rule_opcode::either:
+                stack = (stack >> 1) | (stack & 1u);
+                break;
+
+            case rule_opcode::call:
+                stack = (stack << 1) | uint32_t(calls[instruction.threshold]->match_against(gyro, accel));
+                break;
+        }
+    }
+
+    return size != 0 && (stack & 1u);
+}
+
+bool ipass::rule_program::bind(ipass::leaf_table &table) {
+    /*
+     * Every stack entry describes the intermediate result as
+     * a conjunction of leaves, if it still is one.
+     */
+    struct term {
+        leaf_mask mask;
+        leaf_mask expected;
+        uint8_t literals;
+        bool simple;
+    };
+
+    term stack[max_size];
+    uint8_t depth = 0;
+
+    for (uint8_t i = 0; i < size; i++) {
+        auto &instruction = instructions[i];
+
+        switch (instruction.opcode) {
+            case rule_opcode::always:
+                stack[depth++] = {leaf_mask(), leaf_mask(), 0, true};
+                break;
+
+            case rule_opcode::invert: {
+                auto &top = stack[depth - 1];
+
+                if (top.simple && top.literals == 1) {
+                    for (uint8_t w = 0; w < leaf_mask::word_count; w++) {
+                        top.expected.words[w] ^= top.mask.words[w];
+                    }
+                } else {
+                    top.simple = false;
+                }
+
+                break;
+            }
+
+            case rule_opcode::combine: {
+                const auto &second = stack[--depth];
+                auto &first = stack[depth - 1];
+
+                if (first.simple && second.simple && !first.mask.intersects(second.mask)) {
+                    first.mask |= second.mask;
+                    first.expected |= second.expected;
+                    first.literals += second.literals;
+                } else {
+                    first.simple = false;
+                }
+
+                break;
+            }
+
+            case rule_opcode::either:
+                depth--;
+                stack[depth - 1].simple = false;
+                break;
+
+            default: {
+                const rule_leaf leaf = {
+                    instruction.opcode,
+                    instruction.source,
+                    instruction.axis,
+                    instruction.opcode == rule_opcode::call ? int16_t(0) : instruction.threshold,
+                    instruction.opcode == rule_opcode::call ? calls[instruction.threshold] : nullptr
+                };
+
+                const int16_t index = table.add(leaf);
+
+                if (index < 0) {
+                    conjunction = false;
+                    return false;
+                }
+
+                instruction.leaf = uint8_t(index);
+
+                term leaf_term = {leaf_mask(), leaf_mask(), 1, true};
+                leaf_term.mask.set(instruction.leaf);
+                leaf_term.expected.set(instruction.leaf);
+
+                stack[depth++] = leaf_term;
+                break;
+            }
+        }
+    }
+
+    conjunction = depth == 1 && stack[0].simple;
+
+    if (conjunction) {
+        mask = stack[0].mask;
+        expected = stack[0].expected;
+    }
+
+    return true;
+}
+
+bool ipass::rule_program::is_conjunction() const {
+    return conjunction;
+}
+
+bool ipass::rule_program::match_against(const ipass::leaf_mask &leaves) const {
+    if (conjunction) {
+        return leaves.matches(mask, expected);
+    }
+
+    uint32_t stack = 0;
+
+    for (uint8_t i = 0; i < size; i++) {
+        const auto &instruction = instructions[i];
+
+        switch (instruction.opcode) {
+            case rule_opcode::always:
+                stack = (stack << 1) | 1u;
+                break;
+
+            case rule_opcode::invert:
+                stack ^= 1u;
+                break;
+
+            case rule_opcode::combine:
+                stack = (stack >> 1) & (stack | ~1u);
+                break;
+
+            case rule_opcode::either:
+                stack = (stack >> 1) | (stack & 1u);
+                break;
+
+            default:
+                stack = (stack << 1) | uint32_t(leaves.test(instruction.leaf));
+                break;
+        }
+    }
+
+    return size != 0 && (stack & 1u);
+}
+
+uint32_t ipass::rule_program::match_block(const uint32_t *columns, uint32_t samples) const {
+    if (size == 0) {
+        return 0;
+    }
+
+    // Every stack item holds the intermediate results of all samples
+    uint32_t stack[max_size];
+    uint8_t depth = 0;
+
+    for (uint8_t i = 0; i < size; i++) {
+        const auto &instruction = instructions[i];
+
+        switch (instruction.opcode) {
+            case rule_opcode::always:
+                stack[depth++] = samples;
+                break;
+
+            case rule_opcode::invert:
+                stack[depth - 1] = ~stack[depth - 1];
+                break;
+
+            case rule_opcode::combine:
+                depth--;
+                stack[depth - 1] &= stack[depth];
+                break;
+
+            case rule_opcode::either:
+                depth--;
+                stack[depth - 1] |= stack[depth];
+                break;
+
+            default:
+                stack[depth++] = columns[instruction.leaf];
+                break;
+        }
+    }
+
+    return stack[0] & samples;
+}
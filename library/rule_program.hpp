@@ -0,0 +1,242 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_RULE_PROGRAM_HPP
+#define IPASS_RULE_PROGRAM_HPP
+
+#include <cstdint>
+#include "vector3.hpp"
+#include "motion_rule.hpp"
+#include "leaf_mask.hpp"
+
+namespace ipass {
+
+    class leaf_table;
+
+    /**
+     * \brief
+     * The data source a rule instruction reads from.
+     */
+    enum class rule_source : uint8_t {
+        gyro,
+        accel
+    };
+
+    /**
+     * \brief
+     * Operations a compiled rule program consists of.
+     * \details
+     * The program is stored in postfix order: leaf operations
+     * push their result, invert, combine (and) and either (or)
+     * operate on the results pushed before them.
+     */
+    enum class rule_opcode : uint8_t {
+        always,
+
+        greater_then,
+        equal_to,
+        less_then,
+
+        invert,
+        combine,
+        either,
+
+        call
+    };
+
+    /**
+     * \brief
+     * A single instruction of a compiled rule program.
+     * \details
+     * For the leaf operations the source, axis and threshold
+     * describe the comparison. For the call operation the
+     * threshold is used as index in the program call table.
+     * Once the program is bound to a leaf_table, leaf holds
+     * the index of the leaf in that table.
+     */
+    struct rule_instruction {
+        rule_opcode opcode;
+        rule_source source;
+        uint8_t axis;
+        int16_t threshold;
+        uint8_t leaf;
+    };
+
+    /**
+     * \brief
+     * A motion rule tree lowered to a flat program.
+     * \details
+     * Evaluating a tree of rules costs a virtual call per node
+     * and another switch per leaf. A rule program stores the same
+     * tree as a linear list of instructions, which is evaluated
+     * by a single loop without any virtual dispatch.
+     *
+     * Rules that cannot be lowered (custom motion_rule implementations)
+     * are stored as a call instruction, which falls back to
+     * motion_rule::match_against().
+     *
+     * A program can be bound to a leaf_table, after which it is evaluated
+     * against the leaf results of a sample instead of the sample itself.
+     * Programs that are a plain conjunction of (inverted) leaves are then
+     * resolved with a single mask compare.
+     */
+    class rule_program {
+    public:
+        /**
+         * \brief
+         * The maximum amount of instructions in a program.
+         */
+        constexpr static uint8_t max_size = 16;
+
+        /**
+         * \brief
+         * The maximum amount of call instructions in a program.
+         */
+        constexpr static uint8_t max_calls = 4;
+
+    private:
+        rule_instruction instructions[max_size];
+        const motion_rule *calls[max_calls];
+        uint8_t size;
+        uint8_t call_count;
+
+        leaf_mask mask;
+        leaf_mask expected;
+        bool conjunction;
+
+    public:
+        /**
+         * \brief
+         * 0 argument constructor.
+         * \details
+         * Construct an empty program, which will never match.
+         */
+        rule_program();
+
+        /**
+         * \brief
+         * Append a leaf comparison to the program.
+         * \details
+         * Append the comparison described by the motion
+         * to the program. Returns false if the program is full.
+         * @param source
+         * @param gesture
+         * @param threshold
+         * @return
+         */
+        bool push_leaf(rule_source source, motion gesture, int16_t threshold);
+
+        /**
+         * \brief
+         * Append an instruction to the program.
+         * \details
+         * Returns false if the program is full.
+         * @param opcode
+         * @return
+         */
+        bool push(rule_opcode opcode);
+
+        /**
+         * \brief
+         * Append a fallback call to the given rule.
+         * \details
+         * Returns false if the program or the call table is full.
+         * @param rule
+         * @return
+         */
+        bool push_call(const motion_rule &rule);
+
+        /**
+         * \brief
+         * Remove all instructions from the program.
+         */
+        void clear();
+
+        /**
+         * \brief
+         * Check if the program contains no instructions.
+         * @return
+         */
+        bool empty() const;
+
+        /**
+         * \brief
+         * The amount of instructions in the program.
+         * @return
+         */
+        uint8_t length() const;
+
+        /**
+         * \brief
+         * Access the instruction at the given index.
+         * @param index
+         * @return
+         */
+        const rule_instruction &operator[](uint8_t index) const;
+
+        /**
+         * \brief
+         * Run the program against the given data.
+         * \details
+         * An empty program never matches.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const;
+
+        /**
+         * \brief
+         * Bind the leaves of the program to the given table.
+         * \details
+         * Adds every leaf of the program to the table, storing the
+         * resulting leaf index in the instructions. If the program is a
+         * conjunction of (inverted) leaves, the mask and expected bits
+         * are computed as well.
+         * Returns false if the table is full.
+         * @param table
+         * @return
+         */
+        bool bind(leaf_table &table);
+
+        /**
+         * \brief
+         * Check if the bound program is a plain conjunction of leaves.
+         * @return
+         */
+        bool is_conjunction() const;
+
+        /**
+         * \brief
+         * Run the bound program against the given leaf results.
+         * \details
+         * The leaf results are the result of leaf_table::evaluate()
+         * on the table the program was bound to.
+         * @param leaves
+         * @return
+         */
+        bool match_against(const leaf_mask &leaves) const;
+
+        /**
+         * \brief
+         * Run the bound program against leaf columns of a chunk of samples.
+         * \details
+         * The columns are the result of leaf_table::evaluate_block() on the
+         * table the program was bound to. Every sample of the chunk is
+         * evaluated at once, bit s of the result is set if sample s matches.
+         * Only the bits set in samples are evaluated.
+         * @param columns
+         * @param samples
+         * @return
+         */
+        uint32_t match_block(const uint32_t *columns, uint32_t samples) const;
+    };
+}
+
+#endif //IPASS_RULE_PROGRAM_HPP
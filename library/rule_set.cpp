@@ -0,0 +1,180 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "rule_set.hpp"
+
+namespace {
+    const uint8_t magic[4] = {'I', 'P', 'R', 'S'};
+
+    void write16(uint8_t *buffer, uint16_t value) {
+        buffer[0] = uint8_t(value);
+        buffer[1] = uint8_t(value >> 8);
+    }
+}
+
+ipass::rule_set::rule_set(const uint8_t *data, uint32_t size)
+        : data(data), size(size) {}
+
+uint16_t ipass::rule_set::read16(uint32_t offset) const {
+    return uint16_t(data[offset] | (data[offset + 1] << 8));
+}
+
+uint32_t ipass::rule_set::bindings_offset() const {
+    return header_size + uint32_t(get_node_count()) * node_size;
+}
+
+bool ipass::rule_set::is_valid() const {
+    if (data == nullptr || size < header_size) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+        if (data[i] != magic[i]) {
+            return false;
+        }
+    }
+
+    return data[4] == version
+           && size >= bindings_offset() + uint32_t(get_binding_count()) * binding_size;
+}
+
+uint16_t ipass::rule_set::get_node_count() const {
+    return read16(6);
+}
+
+uint8_t ipass::rule_set::get_binding_count() const {
+    return data[5];
+}
+
+ipass::rule_set_binding ipass::rule_set::get_binding(uint8_t index) const {
+    const uint32_t offset = bindings_offset() + uint32_t(index) * binding_size;
+
+    return {read16(offset), data[offset + 2], trigger_mode(data[offset + 3])};
+}
+
+int16_t ipass::rule_set::load(ipass::rule_arena &arena) const {
+    if (!is_valid()) {
+        return -1;
+    }
+
+    const uint16_t mark = arena.mark();
+    const uint16_t count = get_node_count();
+
+    for (uint16_t i = 0; i < count; i++) {
+        const uint32_t offset = header_size + uint32_t(i) * node_size;
+        const uint8_t *node = data + offset;
+
+        // Operands are stored relative to the set
+        const auto lhs = int16_t(mark + read16(offset + 2));
+        const auto rhs = int16_t(mark + read16(offset + 4));
+
+        int16_t handle = -1;
+
+        switch (rule_node_kind(node[0])) {
+            case rule_node_kind::leaf:
+                if (node[2] <= uint8_t(rule_source::accel) && node[3] <= motion::z_less_then) {
+                    handle = arena.leaf(rule_source(node[2]), motion(node[3]), int16_t(read16(offset + 4)));
+                }
+                break;
+
+            case rule_node_kind::all:
+                handle = arena.all(lhs, rhs);
+                break;
+
+            case rule_node_kind::any:
+                handle = arena.any(lhs, rhs);
+                break;
+
+            case rule_node_kind::invert:
+                handle = arena.invert(lhs);
+                break;
+        }
+
+        // The arena rejects operands that do not precede the node
+        if (handle < 0) {
+            arena.rewind(mark);
+            return -1;
+        }
+    }
+
+    return int16_t(mark);
+}
+
+bool ipass::rule_set::bind(ipass::motion_sensor &sensor, const ipass::rule_arena &arena, int16_t base,
+                           const motion_handler::func *functions, uint8_t function_count) const {
+    if (!is_valid() || base < 0) {
+        return false;
+    }
+
+    // New handlers are added after the existing ones
+    const uint16_t existing = sensor.get_handler_count();
+    bool success = true;
+
+    for (uint8_t i = 0; i < get_binding_count() && success; i++) {
+        const rule_set_binding binding = get_binding(i);
+        rule_program program;
+
+        success = binding.rule < get_node_count()
+                  && binding.handler < function_count
+                  && uint8_t(binding.mode) <= uint8_t(trigger_mode::both)
+                  && arena.compile(int16_t(base + binding.rule), program)
+                  && sensor.when(program, functions[binding.handler], binding.mode) >= 0;
+    }
+
+    // Removing the last handler does not move any other handler
+    while (!success && sensor.get_handler_count() > existing) {
+        sensor.remove_handler(sensor.get_handler_id(uint16_t(sensor.get_handler_count() - 1)));
+    }
+
+    return success;
+}
+
+uint32_t ipass::rule_set::save(const ipass::rule_arena &arena, const ipass::rule_set_binding *bindings,
+                               uint8_t binding_count, uint8_t *buffer, uint32_t capacity) {
+    const uint16_t count = arena.length();
+    const uint32_t total = header_size + uint32_t(count) * node_size + uint32_t(binding_count) * binding_size;
+
+    if (capacity < total) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+        buffer[i] = magic[i];
+    }
+
+    buffer[4] = version;
+    buffer[5] = binding_count;
+    write16(buffer + 6, count);
+
+    uint8_t *out = buffer + header_size;
+
+    for (uint16_t i = 0; i < count; i++, out += node_size) {
+        const rule_node &node = arena[int16_t(i)];
+
+        out[0] = uint8_t(node.kind);
+        out[1] = 0;
+
+        if (node.kind == rule_node_kind::leaf) {
+            out[2] = uint8_t(node.leaf.source);
+            out[3] = node.leaf.gesture;
+            write16(out + 4, uint16_t(node.leaf.threshold));
+        } else {
+            write16(out + 2, node.branch.lhs);
+            write16(out + 4, node.branch.rhs);
+        }
+    }
+
+    for (uint8_t i = 0; i < binding_count; i++, out += binding_size) {
+        write16(out, bindings[i].rule);
+        out[2] = bindings[i].handler;
+        out[3] = uint8_t(bindings[i].mode);
+    }
+
+    return total;
+}
@@ -0,0 +1,165 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_RULE_SET_HPP
+#define IPASS_RULE_SET_HPP
+
+#include <cstdint>
+#include "rule_arena.hpp"
+#include "motion_sensor.hpp"
+
+namespace ipass {
+
+    /**
+     * \brief
+     * Binding of a rule in a rule set to a handler.
+     * \details
+     * The rule is the index of its root node in the set, the
+     * handler is an index in the function table passed to
+     * rule_set::bind().
+     */
+    struct rule_set_binding {
+        uint16_t rule;
+        uint8_t handler;
+        trigger_mode mode;
+    };
+
+    /**
+     * \brief
+     * View of a serialized rule set.
+     * \details
+     * A rule set stores the nodes of a rule_arena and the bindings of
+     * rules to handlers in a compact binary format, so rules can be
+     * updated without rebuilding the firmware. All values are little
+     * endian:
+     *
+     *  - 4 bytes: the magic "IPRS"
+     *  - 1 byte: the format version
+     *  - 1 byte: the amount of bindings
+     *  - 2 bytes: the amount of nodes
+     *  - 6 bytes per node: the kind and a zero byte, followed by the
+     *    source, gesture and threshold of a leaf, or the operand indices
+     *  - 4 bytes per binding: the rule index, handler and trigger mode
+     *
+     * The view does not copy the data, so it can be used directly on a
+     * buffer in flash or a memory mapped file. Loading a set is a single
+     * pass over the nodes, appending them to an arena; the operands of a
+     * node have to precede it, so the nodes are checked as they are added.
+     */
+    class rule_set {
+    public:
+        /**
+         * \brief
+         * The version of the format written by save().
+         */
+        constexpr static uint8_t version = 1;
+
+        constexpr static uint8_t header_size = 8;
+        constexpr static uint8_t node_size = 6;
+        constexpr static uint8_t binding_size = 4;
+
+    private:
+        const uint8_t *data;
+        uint32_t size;
+
+        uint16_t read16(uint32_t offset) const;
+
+        uint32_t bindings_offset() const;
+
+    public:
+        /**
+         * \brief
+         * Constructor with the serialized data.
+         * \details
+         * The set does not own the data.
+         * @param data
+         * @param size
+         */
+        rule_set(const uint8_t *data, uint32_t size);
+
+        /**
+         * \brief
+         * Check the magic, version and size of the data.
+         * \details
+         * The nodes themselves are checked when loading.
+         * @return
+         */
+        bool is_valid() const;
+
+        /**
+         * \brief
+         * The amount of nodes in the set.
+         * @return
+         */
+        uint16_t get_node_count() const;
+
+        /**
+         * \brief
+         * The amount of bindings in the set.
+         * @return
+         */
+        uint8_t get_binding_count() const;
+
+        /**
+         * \brief
+         * Get the binding at the given index.
+         * @param index
+         * @return
+         */
+        rule_set_binding get_binding(uint8_t index) const;
+
+        /**
+         * \brief
+         * Append the nodes of the set to the arena.
+         * \details
+         * Returns the handle of the first node, which has to be added to
+         * the rule indices of the bindings, or -1 if the set is invalid
+         * or does not fit. On failure the arena is left unchanged.
+         * @param arena
+         * @return
+         */
+        int16_t load(rule_arena &arena) const;
+
+        /**
+         * \brief
+         * Register a handler on the sensor for every binding.
+         * \details
+         * Base is the handle returned by load(). The handler of a binding
+         * is looked up in the given function table. If any binding can't be
+         * registered, the handlers registered so far are removed and
+         * false is returned.
+         * @param sensor
+         * @param arena
+         * @param base
+         * @param functions
+         * @param function_count
+         * @return
+         */
+        bool bind(motion_sensor &sensor, const rule_arena &arena, int16_t base,
+                  const motion_handler::func *functions, uint8_t function_count) const;
+
+        /**
+         * \brief
+         * Serialize all nodes of the arena and the given bindings.
+         * \details
+         * Returns the amount of bytes written to the buffer,
+         * or 0 if the buffer is too small.
+         * @param arena
+         * @param bindings
+         * @param binding_count
+         * @param buffer
+         * @param capacity
+         * @return
+         */
+        static uint32_t save(const rule_arena &arena, const rule_set_binding *bindings, uint8_t binding_count,
+                             uint8_t *buffer, uint32_t capacity);
+    };
+}
+
+#endif //IPASS_RULE_SET_HPP
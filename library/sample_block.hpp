@@ -0,0 +1,105 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_SAMPLE_BLOCK_HPP
+#define IPASS_SAMPLE_BLOCK_HPP
+
+#include <cstdint>
+#include "vector3.hpp"
+
+namespace ipass {
+
+    /**
+     * \brief
+     * A block of gyroscope and accelerometer samples.
+     * \details
+     * The samples are stored in structure-of-arrays layout: every
+     * axis of every source is a separate array of count values.
+     * The block does not own the arrays.
+     *
+     * The samples are taken at a fixed interval, starting at timestamp
+     * (both in microseconds), as is the case when draining a sensor FIFO.
+     * Samples with irregular timestamps, like recorded data, can give
+     * the timestamp of every sample instead.
+     *
+     * Blocks are evaluated in chunks of chunk_size samples, the
+     * result of a leaf for a chunk is one bit per sample.
+     */
+    struct sample_block {
+        /**
+         * \brief
+         * The amount of samples evaluated at once.
+         */
+        constexpr static uint8_t chunk_size = 32;
+
+        const int16_t *gyro[3];
+        const int16_t *accel[3];
+        uint16_t count;
+
+        uint_fast64_t timestamp = 0;
+        uint32_t interval = 0;
+
+        /**
+         * \brief
+         * The timestamp of every sample, or nullptr if the samples
+         * are taken at the interval.
+         */
+        const uint_fast64_t *timestamps = nullptr;
+
+        /**
+         * \brief
+         * Get the gyroscope data of the sample at the given index.
+         * @param index
+         * @return
+         */
+        vector3<int16_t> get_gyro(const uint16_t index) const {
+            return {gyro[0][index], gyro[1][index], gyro[2][index]};
+        }
+
+        /**
+         * \brief
+         * Get the accelerometer data of the sample at the given index.
+         * @param index
+         * @return
+         */
+        vector3<int16_t> get_accel(const uint16_t index) const {
+            return {accel[0][index], accel[1][index], accel[2][index]};
+        }
+
+        /**
+         * \brief
+         * Get the timestamp of the sample at the given index.
+         * @param index
+         * @return
+         */
+        uint_fast64_t get_timestamp(const uint16_t index) const {
+            if (timestamps != nullptr) {
+                return timestamps[index];
+            }
+
+            return timestamp + uint_fast64_t(interval) * index;
+        }
+    };
+
+    /**
+     * \brief
+     * A single timestamped sample of both sources.
+     * \details
+     * The temperature is the raw value of the sensor, or 0 if the
+     * sensor does not measure it. The timestamp is in microseconds.
+     */
+    struct motion_sample {
+        vector3<int16_t> gyro;
+        vector3<int16_t> accel;
+        int16_t temperature;
+        uint_fast64_t timestamp;
+    };
+}
+
+#endif //IPASS_SAMPLE_BLOCK_HPP
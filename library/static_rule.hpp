@@ -0,0 +1,292 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_STATIC_RULE_HPP
+#define IPASS_STATIC_RULE_HPP
+
+#include <cstdint>
+#include <type_traits>
+#include "vector3.hpp"
+#include "motion_rule.hpp"
+#include "rule_program.hpp"
+
+namespace ipass {
+
+    /**
+     * \brief
+     * Rules composed at compile time.
+     * \details
+     * The types in this namespace describe a complete rule in its type:
+     * leaves carry their motion and threshold as template arguments and
+     * the combinators store their operands by value. A rule built from
+     * these types is a single inlined predicate without virtual calls or
+     * references, so temporaries can be combined freely and the compiler
+     * can fold the thresholds into the comparisons.
+     *
+     * \code
+     * using namespace ipass::static_rules;
+     *
+     * constexpr auto tilted_backwards =
+     *     gyro<ipass::motion::y_less_then, ipass::gyro_format::from_int(-150)>()
+     *     && !accel<ipass::motion::z_greater_then, ipass::accel_format::from_ratio(9, 10)>();
+     * \endcode
+     *
+     * Use make_rule() to register a static rule on a motion_sensor.
+     */
+    namespace static_rules {
+
+        /**
+         * \brief
+         * Leaf comparing one axis of a source against a threshold.
+         * @tparam Source
+         * @tparam Gesture
+         * @tparam Threshold
+         */
+        template<rule_source Source, motion Gesture, int16_t Threshold>
+        struct leaf {
+            constexpr static uint8_t axis = motion_axis(Gesture);
+            constexpr static uint8_t comparison = motion_comparison(Gesture);
+
+            /**
+             * \brief
+             * Match the leaf against the given data.
+             * @param gyro
+             * @param accel
+             * @return
+             */
+            constexpr bool operator()(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+                return Gesture == motion::none
+                       || compare(Source == rule_source::gyro ? gyro : accel);
+            }
+
+            /**
+             * \brief
+             * Lower the leaf into the given program.
+             * @param program
+             * @return
+             */
+            bool compile(rule_program &program) const {
+                return program.push_leaf(Source, Gesture, Threshold);
+            }
+
+        private:
+            constexpr static bool compare(const vector3<int16_t> &data) {
+                return compare(axis == 0 ? data.x : axis == 1 ? data.y : data.z);
+            }
+
+            constexpr static bool compare(const int16_t value) {
+                return comparison == 0 ? value > Threshold
+                       : comparison == 1 ? value == Threshold
+                       : value < Threshold;
+            }
+        };
+
+        /**
+         * \brief
+         * Leaf on the gyroscope data.
+         */
+        template<motion Gesture, int16_t Threshold>
+        using gyro = leaf<rule_source::gyro, Gesture, Threshold>;
+
+        /**
+         * \brief
+         * Leaf on the accelerometer data.
+         */
+        template<motion Gesture, int16_t Threshold>
+        using accel = leaf<rule_source::accel, Gesture, Threshold>;
+
+        /**
+         * \brief
+         * Rule that matches if both operands match.
+         * \details
+         * Both operands are always evaluated and combined
+         * with a bitwise and, so no branches are generated.
+         */
+        template<typename Lhs, typename Rhs>
+        struct all_of {
+            Lhs lhs;
+            Rhs rhs;
+
+            constexpr bool operator()(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+                return bool(int(lhs(gyro, accel)) & int(rhs(gyro, accel)));
+            }
+
+            bool compile(rule_program &program) const {
+                return lhs.compile(program)
+                       && rhs.compile(program)
+                       && program.push(rule_opcode::combine);
+            }
+        };
+
+        /**
+         * \brief
+         * Rule that matches if either operand matches.
+         * \details
+         * Both operands are always evaluated and combined
+         * with a bitwise or, so no branches are generated.
+         */
+        template<typename Lhs, typename Rhs>
+        struct any_of {
+            Lhs lhs;
+            Rhs rhs;
+
+            constexpr bool operator()(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+                return bool(int(lhs(gyro, accel)) | int(rhs(gyro, accel)));
+            }
+
+            bool compile(rule_program &program) const {
+                return lhs.compile(program)
+                       && rhs.compile(program)
+                       && program.push(rule_opcode::either);
+            }
+        };
+
+        /**
+         * \brief
+         * Rule that matches if the operand does not match.
+         */
+        template<typename Operand>
+        struct not_of {
+            Operand operand;
+
+            constexpr bool operator()(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+                return !operand(gyro, accel);
+            }
+
+            bool compile(rule_program &program) const {
+                return operand.compile(program)
+                       && program.push(rule_opcode::invert);
+            }
+        };
+
+        /**
+         * \brief
+         * Trait that is true for the static rule types.
+         */
+        template<typename T>
+        struct is_rule {
+            constexpr static bool value = false;
+        };
+
+        template<rule_source Source, motion Gesture, int16_t Threshold>
+        struct is_rule<leaf<Source, Gesture, Threshold>> {
+            constexpr static bool value = true;
+        };
+
+        template<typename Lhs, typename Rhs>
+        struct is_rule<all_of<Lhs, Rhs>> {
+            constexpr static bool value = true;
+        };
+
+        template<typename Lhs, typename Rhs>
+        struct is_rule<any_of<Lhs, Rhs>> {
+            constexpr static bool value = true;
+        };
+
+        template<typename Operand>
+        struct is_rule<not_of<Operand>> {
+            constexpr static bool value = true;
+        };
+
+        /**
+         * \brief
+         * Combine two static rules, both have to match.
+         * @param lhs
+         * @param rhs
+         * @return
+         */
+        template<typename Lhs, typename Rhs,
+                typename = typename std::enable_if<is_rule<Lhs>::value && is_rule<Rhs>::value>::type>
+        constexpr all_of<Lhs, Rhs> operator&&(const Lhs &lhs, const Rhs &rhs) {
+            return {lhs, rhs};
+        }
+
+        /**
+         * \brief
+         * Combine two static rules, either has to match.
+         * @param lhs
+         * @param rhs
+         * @return
+         */
+        template<typename Lhs, typename Rhs,
+                typename = typename std::enable_if<is_rule<Lhs>::value && is_rule<Rhs>::value>::type>
+        constexpr any_of<Lhs, Rhs> operator||(const Lhs &lhs, const Rhs &rhs) {
+            return {lhs, rhs};
+        }
+
+        /**
+         * \brief
+         * Invert a static rule.
+         * @param operand
+         * @return
+         */
+        template<typename Operand,
+                typename = typename std::enable_if<is_rule<Operand>::value>::type>
+        constexpr not_of<Operand> operator!(const Operand &operand) {
+            return {operand};
+        }
+
+        /**
+         * \brief
+         * Adapter to use a static rule as a motion_rule.
+         * \details
+         * The adapter holds the static rule by value. When registered
+         * on a motion_sensor the rule is compiled like any other rule.
+         * @tparam Rule
+         */
+        template<typename Rule>
+        class adapter : public motion_rule {
+        private:
+            Rule rule;
+
+        public:
+            /**
+             * \brief
+             * Constructor with the static rule to adapt.
+             * @param rule
+             */
+            explicit adapter(const Rule &rule) : rule(rule) {}
+
+            /**
+             * \brief
+             * Will match the given data against the static rule.
+             * @param gyro
+             * @param accel
+             * @return
+             */
+            bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const override {
+                return rule(gyro, accel);
+            }
+
+            /**
+             * \brief
+             * Lower the static rule into the program.
+             * @param program
+             * @return
+             */
+            bool compile(rule_program &program) const override {
+                return rule.compile(program);
+            }
+        };
+
+        /**
+         * \brief
+         * Wrap a static rule in an adapter, so it can be used as motion_rule.
+         * @param rule
+         * @return
+         */
+        template<typename Rule,
+                typename = typename std::enable_if<is_rule<Rule>::value>::type>
+        adapter<Rule> make_rule(const Rule &rule) {
+            return adapter<Rule>(rule);
+        }
+    }
+}
+
+#endif //IPASS_STATIC_RULE_HPP
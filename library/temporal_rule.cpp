@@ -0,0 +1,181 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "temporal_rule.hpp"
+
+ipass::temporal_rule::temporal_rule(ipass::rule_program *conditions, uint8_t capacity)
+        : conditions(conditions), capacity(capacity), size(0) {}
+
+bool ipass::temporal_rule::add_condition(const ipass::motion_rule &rule) {
+    if (size >= capacity || size >= max_conditions) {
+        return false;
+    }
+
+    conditions[size].clear();
+
+    // A tree that does not fit a program is evaluated as a single leaf
+    if (!rule.compile(conditions[size])) {
+        conditions[size].clear();
+        conditions[size].push_call(rule);
+    }
+
+    size++;
+    return true;
+}
+
+uint8_t ipass::temporal_rule::length() const {
+    return size;
+}
+
+const ipass::rule_program &ipass::temporal_rule::get_condition(uint8_t index) const {
+    return conditions[index];
+}
+
+bool ipass::temporal_rule::bind(ipass::leaf_table &table) {
+    for (uint8_t i = 0; i < size; i++) {
+        if (!conditions[i].bind(table)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint32_t ipass::temporal_rule::match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    uint32_t matches = 0;
+
+    for (uint8_t i = 0; i < size; i++) {
+        matches |= uint32_t(conditions[i].match_against(gyro, accel)) << i;
+    }
+
+    return matches;
+}
+
+uint32_t ipass::temporal_rule::match_against(const ipass::leaf_mask &leaves) const {
+    uint32_t matches = 0;
+
+    for (uint8_t i = 0; i < size; i++) {
+        matches |= uint32_t(conditions[i].match_against(leaves)) << i;
+    }
+
+    return matches;
+}
+
+bool ipass::temporal_rule::update(const vector3<int16_t> &gyro, const vector3<int16_t> &accel,
+                                  uint_fast64_t timestamp) {
+    return update(match_against(gyro, accel), timestamp);
+}
+
+ipass::sequence_rule::sequence_rule()
+        : temporal_rule(steps, max_steps), steps(), windows(), reached(), active(0) {}
+
+bool ipass::sequence_rule::then(const ipass::motion_rule &rule, uint_fast64_t within) {
+    const uint8_t index = length();
+
+    if (!add_condition(rule)) {
+        return false;
+    }
+
+    windows[index] = within;
+    return true;
+}
+
+bool ipass::sequence_rule::update(uint32_t matches, uint_fast64_t timestamp) {
+    const uint8_t size = length();
+
+    if (size == 0) {
+        return false;
+    }
+
+    /*
+     * Walk the steps from last to first, so a single
+     * sample can't advance the sequence more than one step.
+     */
+    for (uint8_t i = size - 1; i > 0; i--) {
+        const bool previous = ((active >> (i - 1)) & 1u)
+                              && timestamp - reached[i - 1] <= windows[i];
+
+        if (!previous) {
+            active &= ~(uint32_t(1) << (i - 1));
+            continue;
+        }
+
+        if ((matches >> i) & 1u) {
+            if (i == size - 1) {
+                reset();
+                return true;
+            }
+
+            reached[i] = timestamp;
+            active |= uint32_t(1) << i;
+        }
+    }
+
+    if (matches & 1u) {
+        if (size == 1) {
+            return true;
+        }
+
+        reached[0] = timestamp;
+        active |= 1u;
+    }
+
+    return false;
+}
+
+void ipass::sequence_rule::reset() {
+    active = 0;
+}
+
+ipass::hysteresis_rule::hysteresis_rule(const ipass::motion_rule &enter, const ipass::motion_rule &exit)
+        : temporal_rule(conditions, 2), conditions(), active(false) {
+    if (!add_condition(enter) || !add_condition(exit)) {
+        conditions[0].clear();
+    }
+}
+
+bool ipass::hysteresis_rule::update(uint32_t matches, uint_fast64_t) {
+    const bool enter = matches & 1u;
+    const bool exit = (matches >> 1) & 1u;
+
+    if (active) {
+        active = !exit;
+    } else {
+        active = enter;
+    }
+
+    return active;
+}
+
+void ipass::hysteresis_rule::reset() {
+    active = false;
+}
+
+ipass::duration_rule::duration_rule(const ipass::motion_rule &rule, uint_fast64_t duration)
+        : temporal_rule(&condition, 1), condition(), duration(duration), since(0), holding(false) {
+    add_condition(rule);
+}
+
+bool ipass::duration_rule::update(uint32_t matches, uint_fast64_t timestamp) {
+    if (!(matches & 1u)) {
+        holding = false;
+        return false;
+    }
+
+    if (!holding) {
+        holding = true;
+        since = timestamp;
+    }
+
+    return timestamp - since >= duration;
+}
+
+void ipass::duration_rule::reset() {
+    holding = false;
+}
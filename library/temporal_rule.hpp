@@ -0,0 +1,317 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_TEMPORAL_RULE_HPP
+#define IPASS_TEMPORAL_RULE_HPP
+
+#include <cstdint>
+#include "vector3.hpp"
+#include "motion_rule.hpp"
+#include "rule_program.hpp"
+#include "leaf_table.hpp"
+
+namespace ipass {
+
+    /**
+     * \brief
+     * Base class for a rule that depends on earlier samples.
+     * \details
+     * A temporal rule is built from one or more regular rules, its
+     * conditions. Every sample the conditions are matched (sharing the
+     * leaves of the sensor) and the results are passed to update(),
+     * which advances the state of the rule and reports a match.
+     *
+     * Because a temporal rule has state, the sensor keeps a reference
+     * to it: it must outlive its registration and can be registered
+     * on only one sensor at a time. A temporal rule can't be copied or
+     * moved, since the base class points at the conditions stored by
+     * the derived rule.
+     */
+    class temporal_rule {
+    public:
+        /**
+         * \brief
+         * The maximum amount of conditions of a temporal rule.
+         */
+        constexpr static uint8_t max_conditions = 8;
+
+    private:
+        rule_program *conditions;
+        uint8_t capacity;
+        uint8_t size;
+
+    protected:
+        /**
+         * \brief
+         * Constructor with the storage for the conditions.
+         * @param conditions
+         * @param capacity
+         */
+        temporal_rule(rule_program *conditions, uint8_t capacity);
+
+        /**
+         * \brief
+         * Compile the given rule as the next condition.
+         * \details
+         * Returns false if there is no room for the condition
+         * (at most max_conditions). A rule that does not fit in a
+         * rule_program is evaluated through motion_rule::match_against().
+         * @param rule
+         * @return
+         */
+        bool add_condition(const motion_rule &rule);
+
+    public:
+        temporal_rule(const temporal_rule &) = delete;
+
+        temporal_rule &operator=(const temporal_rule &) = delete;
+
+        /**
+         * \brief
+         * The amount of conditions of the rule.
+         * @return
+         */
+        uint8_t length() const;
+
+        /**
+         * \brief
+         * Get the compiled condition at the given index.
+         * @param index
+         * @return
+         */
+        const rule_program &get_condition(uint8_t index) const;
+
+        /**
+         * \brief
+         * Bind all conditions to the given leaf table.
+         * \details
+         * Returns false if the table is full.
+         * @param table
+         * @return
+         */
+        bool bind(leaf_table &table);
+
+        /**
+         * \brief
+         * Match all conditions against the given data.
+         * \details
+         * Bit i of the result is set if condition i matches.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        uint32_t match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const;
+
+        /**
+         * \brief
+         * Match all bound conditions against the given leaf results.
+         * \details
+         * Bit i of the result is set if condition i matches.
+         * @param leaves
+         * @return
+         */
+        uint32_t match_against(const leaf_mask &leaves) const;
+
+        /**
+         * \brief
+         * Advance the rule with the condition results of a sample.
+         * \details
+         * Returns true if the rule matches at this sample.
+         * Timestamps are in microseconds and must not decrease.
+         * @param matches
+         * @param timestamp
+         * @return
+         */
+        virtual bool update(uint32_t matches, uint_fast64_t timestamp) = 0;
+
+        /**
+         * \brief
+         * Advance the rule with the given data.
+         * @param gyro
+         * @param accel
+         * @param timestamp
+         * @return
+         */
+        bool update(const vector3<int16_t> &gyro, const vector3<int16_t> &accel, uint_fast64_t timestamp);
+
+        /**
+         * \brief
+         * Forget all state of the rule.
+         */
+        virtual void reset() = 0;
+    };
+
+    /**
+     * \brief
+     * A sequence of rules that have to match in order.
+     * \details
+     * Every step after the first has a time window: the step has to
+     * match within that many microseconds after the previous step last
+     * matched. The rule matches once, at the sample the last step
+     * matches, after which the sequence starts over.
+     *
+     * The sequence is tracked as a small automaton with one state per
+     * step, holding the most recent time that step was reached. Keeping
+     * only the most recent time is enough, since a later start always
+     * leaves more of the window. Every sample costs one pass over the
+     * steps, no history is stored or rescanned.
+     *
+     * \code
+     * ipass::sequence_rule tilt_forward_and_back;
+     * tilt_forward_and_back.then(tilted_forwards);
+     * tilt_forward_and_back.then(tilted_backwards, 300000);
+     * \endcode
+     */
+    class sequence_rule : public temporal_rule {
+    public:
+        /**
+         * \brief
+         * The maximum amount of steps in a sequence.
+         */
+        constexpr static uint8_t max_steps = max_conditions;
+
+    private:
+        rule_program steps[max_steps];
+        uint_fast64_t windows[max_steps];
+        uint_fast64_t reached[max_steps];
+        uint32_t active;
+
+    public:
+        /**
+         * \brief
+         * 0 argument constructor.
+         * \details
+         * Construct an empty sequence, which never matches.
+         */
+        sequence_rule();
+
+        /**
+         * \brief
+         * Add a step to the sequence.
+         * \details
+         * The step has to match within the given amount of microseconds
+         * after the previous step, by default there is no limit. The window
+         * of the first step is ignored.
+         * Returns false if the sequence is full.
+         * @param rule
+         * @param within
+         * @return
+         */
+        bool then(const motion_rule &rule, uint_fast64_t within = UINT_FAST64_MAX);
+
+        using temporal_rule::update;
+
+        /**
+         * \brief
+         * Advance the sequence with the step results of a sample.
+         * @param matches
+         * @param timestamp
+         * @return
+         */
+        bool update(uint32_t matches, uint_fast64_t timestamp) override;
+
+        /**
+         * \brief
+         * Forget all partially matched sequences.
+         */
+        void reset() override;
+    };
+
+    /**
+     * \brief
+     * A rule with separate enter and exit conditions.
+     * \details
+     * The rule starts matching when the enter rule matches, and keeps
+     * matching until the exit rule matches. With an exit threshold a bit
+     * below the enter threshold, a value hovering around the enter
+     * threshold does not make the rule flip on and off every sample.
+     *
+     * \code
+     * ipass::gyro_rule enter = {ipass::motion::y_less_then, ipass::gyro_format::from_int(-150)};
+     * ipass::gyro_rule exit = {ipass::motion::y_greater_then, ipass::gyro_format::from_int(-120)};
+     * ipass::hysteresis_rule tilted_backwards(enter, exit);
+     * \endcode
+     */
+    class hysteresis_rule : public temporal_rule {
+    private:
+        rule_program conditions[2];
+        bool active;
+
+    public:
+        /**
+         * \brief
+         * Constructor with the enter and exit rules.
+         * @param enter
+         * @param exit
+         */
+        hysteresis_rule(const motion_rule &enter, const motion_rule &exit);
+
+        using temporal_rule::update;
+
+        /**
+         * \brief
+         * Advance the rule with the enter and exit results of a sample.
+         * @param matches
+         * @param timestamp
+         * @return
+         */
+        bool update(uint32_t matches, uint_fast64_t timestamp) override;
+
+        /**
+         * \brief
+         * Make the rule inactive.
+         */
+        void reset() override;
+    };
+
+    /**
+     * \brief
+     * A rule that has to match for a minimum duration.
+     * \details
+     * The rule matches once the given rule has matched on every
+     * sample for at least the given amount of microseconds, and
+     * keeps matching for as long as the given rule matches.
+     * Short spikes in the sensor data are ignored this way.
+     */
+    class duration_rule : public temporal_rule {
+    private:
+        rule_program condition;
+        uint_fast64_t duration;
+        uint_fast64_t since;
+        bool holding;
+
+    public:
+        /**
+         * \brief
+         * Constructor with the rule and the minimum duration in microseconds.
+         * @param rule
+         * @param duration
+         */
+        duration_rule(const motion_rule &rule, uint_fast64_t duration);
+
+        using temporal_rule::update;
+
+        /**
+         * \brief
+         * Advance the rule with the result of a sample.
+         * @param matches
+         * @param timestamp
+         * @return
+         */
+        bool update(uint32_t matches, uint_fast64_t timestamp) override;
+
+        /**
+         * \brief
+         * Forget how long the rule has been matching.
+         */
+        void reset() override;
+    };
+}
+
+#endif //IPASS_TEMPORAL_RULE_HPP
@@ -9,7 +9,19 @@
 
 #include "../vector3.hpp"
 #include "../motion_sensor.hpp"
+#include "../static_rule.hpp"
+#include "../vector_rule.hpp"
+#include "../rule_arena.hpp"
+#include "../rule_set.hpp"
+#include "../rule_parser.hpp"
+#include "../event_queue.hpp"
+#include "../worker_pool.hpp"
 #include "mock_sensor.hpp"
+#include "mock_i2c_bus.hpp"
+#include "mock_pin_in.hpp"
+#include "../../demo/mpu6050.hpp"
+
+#include <type_traits>
 
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
@@ -155,6 +167,50 @@ TEST_CASE("ipass::vector3 data access") {
     REQUIRE(v[2] == 3);
 }
 
+TEST_CASE("ipass::vector3 shifts") {
+    ipass::vector3<int16_t> vec{16384, -16384, 3};
+
+    REQUIRE((vec >> 3) == ipass::vector3<int16_t>{2048, -2048, 0});
+    REQUIRE((vec >> 3 << 2) == ipass::vector3<int16_t>{8192, -8192, 0});
+
+    vec >>= 1;
+    REQUIRE(vec == ipass::vector3<int16_t>{8192, -8192, 1});
+
+    vec <<= 1;
+    REQUIRE(vec == ipass::vector3<int16_t>{16384, -16384, 2});
+}
+
+/* Fixed point tests */
+TEST_CASE("ipass::q_format converts constants at compile time") {
+    static_assert(ipass::accel_format::one == 2048, "1 g");
+    static_assert(ipass::gyro_format::one == 16, "1 dps");
+
+    static_assert(ipass::accel_format::from_int(-2) == -4096, "-2 g");
+    static_assert(ipass::accel_format::from_ratio(9, 10) == 1843, "0.9 g");
+    static_assert(ipass::accel_format::from_ratio(-9, 10) == -1843, "-0.9 g");
+    static_assert(ipass::gyro_format::from_ratio(-1505, 10) == -2408, "-150.5 dps");
+
+    // Out of range values are clamped, or left to the caller
+    static_assert(ipass::accel_format::from_ratio(20, 1) == INT16_MAX, "20 g");
+    static_assert(ipass::accel_format::scale(20, 1) == 40960, "20 g");
+
+    REQUIRE(ipass::accel_format::to_int(3072) == 1);
+    REQUIRE(ipass::accel_format::to_int(-3072) == -2);
+    REQUIRE(ipass::accel_format::to_milli(1843) == 899);
+    REQUIRE(ipass::gyro_format::to_int(-2400) == -150);
+}
+
+TEST_CASE("ipass::q_format converts raw counts with a multiply and a shift") {
+    // 131 counts per dps, 16 per dps in the format
+    const int32_t multiplier = (16 << 16) / 131;
+
+    REQUIRE(ipass::gyro_format::from_raw(131 * 150, multiplier, 16) == 150 * 16);
+    REQUIRE(ipass::gyro_format::from_raw(-131 * 150, multiplier, 16) == -150 * 16);
+    REQUIRE(ipass::gyro_format::from_raw(0, multiplier, 16) == 0);
+    REQUIRE(ipass::gyro_format::from_raw(INT16_MAX, multiplier, 16) == 4002);
+    REQUIRE(ipass::accel_format::from_raw(1000, 1, 0) == 1000);
+}
+
 /* Motion sensor tests */
 TEST_CASE("ipass::motion_sensor get gyro and accel") {
     ipass::vector3<int16_t> gyro = {9, -5, 2};
@@ -223,6 +279,10 @@ TEST_CASE("ipass::gyro_corrected_motion_sensor adjusted gyro") {
 
     REQUIRE(m.get_gyro() == gyro - correction);
     REQUIRE(m.get_accel() == accel);
+
+    const auto sample = m.get_sample();
+    REQUIRE(sample.gyro == gyro - correction);
+    REQUIRE(sample.accel == accel);
 }
 
 TEST_CASE("ipass::accel_corrected_motion_sensor adjusted accel") {
@@ -235,9 +295,76 @@ TEST_CASE("ipass::accel_corrected_motion_sensor adjusted accel") {
 
     REQUIRE(m.get_gyro() == gyro);
     REQUIRE(m.get_accel() == accel - correction);
+
+    const auto sample = m.get_sample();
+    REQUIRE(sample.gyro == gyro);
+    REQUIRE(sample.accel == accel - correction);
+}
+
+namespace {
+    class sampling_sensor : public ipass::test::mock_sensor {
+    public:
+        int acquisitions = 0;
+
+        ipass::motion_sample get_sample() override {
+            acquisitions++;
+            return {{200, 0, 0}, {0, 0, 1}, 25, get_timestamp()};
+        }
+    };
+}
+
+TEST_CASE("ipass::motion_sensor reads a sample in one acquisition") {
+    sampling_sensor base;
+    ipass::gyro_corrected_motion_sensor corrected(base, {100, 0, 0});
+    ipass::with_handlers<ipass::cached_motion_sensor> m(corrected);
+
+    static int count;
+    count = 0;
+
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 50};
+    m.when(tilted, [](const auto &, const auto &) { count++; });
+
+    // The decorators pass the whole sample
+    m.refresh();
+    REQUIRE(base.acquisitions == 1);
+    REQUIRE(m.get_gyro() == ipass::vector3<int16_t>(100, 0, 0));
+    REQUIRE(m.get_sample().temperature == 25);
+
+    m.process_handlers();
+    REQUIRE(count == 1);
+    REQUIRE(base.acquisitions == 1);
+
+    // A sample that was already read is not read again
+    corrected.when(tilted, [](const auto &, const auto &) { count++; });
+
+    const auto sample = corrected.get_sample();
+    corrected.process_handlers(sample);
+    REQUIRE(count == 2);
+    REQUIRE(base.acquisitions == 2);
+
+    corrected.process_handlers();
+    REQUIRE(count == 3);
+    REQUIRE(base.acquisitions == 3);
 }
 
 /* Motion rule tests */
+TEST_CASE("ipass::motion splits into an axis and a comparison") {
+    static_assert(ipass::motion_axis(ipass::motion::y_equal_to) == 1, "y");
+    static_assert(ipass::motion_comparison(ipass::motion::z_less_then) == 2, "less");
+
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        for (uint8_t comparison = 0; comparison < 3; comparison++) {
+            const ipass::motion gesture = ipass::make_motion(axis, comparison);
+
+            REQUIRE(ipass::motion_axis(gesture) == axis);
+            REQUIRE(ipass::motion_comparison(gesture) == comparison);
+        }
+    }
+
+    REQUIRE(ipass::make_motion(0, 0) == ipass::motion::x_greater_then);
+    REQUIRE(ipass::make_motion(2, 2) == ipass::motion::z_less_then);
+}
+
 TEST_CASE("ipass::gyro_rule applies to gyro") {
     ipass::vector3<int16_t> gyro = {0, 0, 1};
     ipass::vector3<int16_t> accel = {0, 0, 1};
@@ -356,4 +483,2113 @@ TEST_CASE("ipass::motion_rule rules can be combined") {
 
         REQUIRE_FALSE(success);
     }
-}
\ No newline at end of file
+}
+
+/* Rule program tests */
+TEST_CASE("ipass::rule_program matches like the rule tree") {
+    ipass::gyro_rule tilted = {ipass::motion::y_less_then, -150};
+    ipass::accel_rule flat = {ipass::motion::z_equal_to, 1};
+    ipass::inverted_motion_rule not_flat(flat);
+
+    auto rule = tilted + not_flat;
+
+    ipass::rule_program program;
+    REQUIRE(rule.compile(program));
+    REQUIRE(program.length() == 4);
+
+    ipass::vector3<int16_t> samples[] = {{0, -200, 0}, {0, -100, 0}, {0, -150, 0}, {5, -151, 3}};
+    ipass::vector3<int16_t> accels[] = {{0, 0, 1}, {0, 0, 0}, {1, 1, 1}, {0, 0, 2}};
+
+    for (const auto &gyro : samples) {
+        for (const auto &accel : accels) {
+            REQUIRE(program.match_against(gyro, accel) == rule.match_against(gyro, accel));
+        }
+    }
+}
+
+TEST_CASE("ipass::rule_program falls back to custom rules") {
+    struct odd_rule : public ipass::motion_rule {
+        bool match_against(const ipass::vector3<int16_t> &gyro, const ipass::vector3<int16_t> &) const override {
+            return gyro.x % 2 != 0;
+        }
+    };
+
+    odd_rule odd;
+    ipass::accel_rule up = {ipass::motion::z_greater_then, 0};
+    auto rule = odd + up;
+
+    ipass::rule_program program;
+    REQUIRE(rule.compile(program));
+
+    REQUIRE(program.match_against({1, 0, 0}, {0, 0, 1}));
+    REQUIRE_FALSE(program.match_against({2, 0, 0}, {0, 0, 1}));
+    REQUIRE_FALSE(program.match_against({1, 0, 0}, {0, 0, 0}));
+}
+
+TEST_CASE("ipass::either_motion_rule matches either rule") {
+    ipass::gyro_rule forwards = {ipass::motion::y_greater_then, 150};
+    ipass::gyro_rule backwards = {ipass::motion::y_less_then, -150};
+    auto rule = forwards | backwards;
+
+    ipass::rule_program program;
+    REQUIRE(rule.compile(program));
+
+    const ipass::vector3<int16_t> accel;
+    const int16_t ys[] = {-200, -150, 0, 150, 200};
+
+    for (auto y : ys) {
+        const bool expected = y > 150 || y < -150;
+
+        REQUIRE(rule.match_against({0, y, 0}, accel) == expected);
+        REQUIRE(program.match_against({0, y, 0}, accel) == expected);
+    }
+}
+
+TEST_CASE("ipass::motion_sensor accepts rules that do not fit a program") {
+    ipass::test::mock_sensor m;
+
+    static int count;
+    count = 0;
+    const auto increment = [](const auto &, const auto &) { count++; };
+
+    ipass::gyro_rule leaf = {ipass::motion::x_greater_then, 0};
+    ipass::combined_motion_rule c1(leaf, leaf);
+    ipass::combined_motion_rule c2(c1, c1);
+    ipass::combined_motion_rule c3(c2, c2);
+    ipass::combined_motion_rule c4(c3, c3);
+
+    ipass::rule_program program;
+    REQUIRE_FALSE(c4.compile(program));
+
+    REQUIRE(m.when(c3, increment) >= 0);
+    REQUIRE(m.when(c4, increment) >= 0);
+
+    m.set_gyro({10, 0, 0});
+    m.process_handlers();
+    REQUIRE(count == 2);
+
+    m.set_gyro({-10, 0, 0});
+    m.process_handlers();
+    REQUIRE(count == 2);
+}
+
+/* Leaf table tests */
+TEST_CASE("ipass::leaf_table shares leaves between rules") {
+    ipass::gyro_rule backwards = {ipass::motion::y_less_then, -150};
+    ipass::gyro_rule forwards = {ipass::motion::y_greater_then, 150};
+    ipass::accel_rule flat = {ipass::motion::z_equal_to, 1};
+    ipass::inverted_motion_rule not_flat(flat);
+
+    auto tilted_backwards = backwards + not_flat;
+    auto tilted_forwards = forwards + not_flat;
+
+    ipass::leaf_table table;
+    ipass::rule_program p1, p2;
+
+    REQUIRE(tilted_backwards.compile(p1));
+    REQUIRE(tilted_forwards.compile(p2));
+    REQUIRE(p1.bind(table));
+    REQUIRE(p2.bind(table));
+
+    REQUIRE(table.length() == 3);
+    REQUIRE(p1.is_conjunction());
+    REQUIRE(p2.is_conjunction());
+
+    const auto results = table.evaluate({0, -200, 0}, {0, 0, 0});
+    REQUIRE(p1.match_against(results));
+    REQUIRE_FALSE(p2.match_against(results));
+
+    REQUIRE_FALSE(p1.match_against(table.evaluate({0, -200, 0}, {0, 0, 1})));
+}
+
+TEST_CASE("ipass::rule_program bound evaluation matches the rule tree") {
+    ipass::gyro_rule a = {ipass::motion::x_greater_then, 10};
+    ipass::accel_rule b = {ipass::motion::z_less_then, 0};
+    auto both = a + b;
+    ipass::inverted_motion_rule rule(both);
+
+    ipass::leaf_table table;
+    ipass::rule_program program;
+
+    REQUIRE(rule.compile(program));
+    REQUIRE(program.bind(table));
+    REQUIRE_FALSE(program.is_conjunction());
+
+    ipass::vector3<int16_t> gyros[] = {{11, 0, 0}, {10, 0, 0}};
+    ipass::vector3<int16_t> accels[] = {{0, 0, -1}, {0, 0, 0}};
+
+    for (const auto &gyro : gyros) {
+        for (const auto &accel : accels) {
+            REQUIRE(program.match_against(table.evaluate(gyro, accel)) == rule.match_against(gyro, accel));
+        }
+    }
+}
+
+TEST_CASE("ipass::motion_sensor handlers share leaves") {
+    ipass::vector3<int16_t> gyro = {0, -200, 0};
+    ipass::vector3<int16_t> accel = {0, 0, 0};
+    ipass::test::mock_sensor m(gyro, accel);
+
+    ipass::gyro_rule backwards = {ipass::motion::y_less_then, -150};
+    ipass::gyro_rule forwards = {ipass::motion::y_greater_then, 150};
+    ipass::accel_rule flat = {ipass::motion::z_equal_to, 1};
+    ipass::inverted_motion_rule not_flat(flat);
+
+    auto tilted_backwards = backwards + not_flat;
+    auto tilted_forwards = forwards + not_flat;
+
+    static int backwards_count = 0;
+    static int forwards_count = 0;
+
+    REQUIRE(m.when(tilted_backwards, [](const auto &, const auto &) { backwards_count++; }) == 0);
+    const auto forwards_handler = m.when(tilted_forwards, [](const auto &, const auto &) { forwards_count++; });
+
+    m.process_handlers();
+    REQUIRE(backwards_count == 1);
+    REQUIRE(forwards_count == 0);
+
+    m.remove_handler(forwards_handler);
+    m.set_gyro({0, 200, 0});
+    m.process_handlers();
+
+    REQUIRE(backwards_count == 1);
+    REQUIRE(forwards_count == 0);
+}
+
+/* Threshold index tests */
+TEST_CASE("ipass::threshold_index matches the linear leaf evaluation") {
+    ipass::leaf_table linear;
+    const ipass::rule_opcode comparisons[] = {
+        ipass::rule_opcode::greater_then,
+        ipass::rule_opcode::equal_to,
+        ipass::rule_opcode::less_then
+    };
+
+    uint32_t seed = 12345;
+    auto next = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return int16_t(int16_t((seed >> 16) % 41) - 20);
+    };
+
+    while (linear.length() < ipass::leaf_mask::capacity) {
+        const auto value = next();
+        const auto kind = uint8_t(next() + 20);
+
+        linear.add({
+            comparisons[kind % 3],
+            ipass::rule_source(kind % 2),
+            uint8_t(kind % 3),
+            value,
+            nullptr
+        });
+    }
+
+    auto indexed = linear;
+    indexed.build_index();
+
+    REQUIRE(indexed.is_indexed());
+    REQUIRE_FALSE(linear.is_indexed());
+
+    for (int i = 0; i < 500; i++) {
+        const ipass::vector3<int16_t> gyro = {next(), next(), next()};
+        const ipass::vector3<int16_t> accel = {next(), next(), next()};
+
+        REQUIRE(indexed.evaluate(gyro, accel) == linear.evaluate(gyro, accel));
+    }
+}
+
+/* Sample block tests */
+TEST_CASE("ipass::motion_sensor block processing matches per sample processing") {
+    constexpr uint16_t count = 75;
+    int16_t lanes[6][count];
+
+    uint32_t seed = 777;
+    for (auto &lane : lanes) {
+        for (auto &value : lane) {
+            seed = seed * 1103515245 + 12345;
+            value = int16_t((seed >> 16) % 401) - 200;
+        }
+    }
+
+    const ipass::sample_block block = {
+        {lanes[0], lanes[1], lanes[2]},
+        {lanes[3], lanes[4], lanes[5]},
+        count
+    };
+
+    ipass::gyro_rule backwards = {ipass::motion::y_less_then, -100};
+    ipass::gyro_rule left = {ipass::motion::x_greater_then, 50};
+    ipass::accel_rule flat = {ipass::motion::z_equal_to, 0};
+    ipass::accel_rule up = {ipass::motion::z_greater_then, -50};
+    ipass::inverted_motion_rule not_up(up);
+
+    auto backwards_left = backwards + left;
+    auto not_both = ipass::inverted_motion_rule(backwards_left);
+    auto flat_or_down = flat + not_up;
+
+    static uint32_t block_hits[4];
+    static uint32_t sample_hits[4];
+    static uint32_t *hits;
+
+    auto register_handlers = [&](ipass::motion_sensor &m) {
+        m.when(backwards_left, [](const auto &g, const auto &) { hits[0] += uint16_t(g.x); });
+        m.when(not_both, [](const auto &g, const auto &) { hits[1] += uint16_t(g.y); });
+        m.when(flat_or_down, [](const auto &, const auto &a) { hits[2] += uint16_t(a.z); });
+        m.when(up, [](const auto &, const auto &) { hits[3]++; });
+    };
+
+    ipass::test::mock_sensor batch;
+    register_handlers(batch);
+    hits = block_hits;
+    batch.process_handlers(block);
+
+    ipass::test::mock_sensor single;
+    register_handlers(single);
+    hits = sample_hits;
+
+    for (uint16_t i = 0; i < count; i++) {
+        single.set_gyro(block.get_gyro(i));
+        single.set_accel(block.get_accel(i));
+        single.process_handlers();
+    }
+
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(block_hits[i] == sample_hits[i]);
+    }
+
+    REQUIRE(sample_hits[3] > 0);
+}
+
+TEST_CASE("ipass::motion_sensor span processing matches per sample processing") {
+    constexpr uint16_t count = 70;
+    ipass::motion_sample samples[count];
+
+    uint32_t seed = 4242;
+    uint_fast64_t timestamp = 1000;
+
+    for (auto &sample : samples) {
+        int16_t values[6];
+
+        for (auto &value : values) {
+            seed = seed * 1103515245 + 12345;
+            value = int16_t((seed >> 16) % 401) - 200;
+        }
+
+        // Irregular intervals, like recorded data
+        timestamp += 5 + (seed >> 24) % 20;
+        sample = {{values[0], values[1], values[2]}, {values[3], values[4], values[5]}, 0, timestamp};
+    }
+
+    ipass::gyro_rule left = {ipass::motion::x_greater_then, 50};
+    ipass::accel_rule up = {ipass::motion::z_greater_then, -50};
+
+    static uint32_t span_hits[3];
+    static uint32_t sample_hits[3];
+    static uint32_t *hits;
+
+    auto register_handlers = [&](ipass::motion_sensor &m) {
+        m.when(left, [](const auto &g, const auto &) { hits[0] += uint16_t(g.x); });
+        m.when(up, [](const auto &, const auto &) { hits[1]++; }, ipass::trigger_mode::rising);
+
+        const auto limited = m.when(left, [](const auto &, const auto &) { hits[2]++; });
+        m.set_refractory(limited, 40);
+    };
+
+    ipass::test::mock_sensor batch;
+    register_handlers(batch);
+    hits = span_hits;
+    batch.process_handlers(samples, count);
+
+    ipass::test::mock_sensor single;
+    register_handlers(single);
+    hits = sample_hits;
+
+    for (const auto &sample : samples) {
+        single.set_gyro(sample.gyro);
+        single.set_accel(sample.accel);
+        single.set_timestamp(sample.timestamp);
+        single.process_handlers();
+    }
+
+    for (int i = 0; i < 3; i++) {
+        REQUIRE(span_hits[i] == sample_hits[i]);
+    }
+
+    REQUIRE(sample_hits[1] > 0);
+    REQUIRE(sample_hits[2] > 0);
+}
+
+/* Static rule tests */
+TEST_CASE("ipass::static_rules are evaluated at compile time") {
+    using namespace ipass::static_rules;
+
+    constexpr auto tilted_backwards =
+            gyro<ipass::motion::y_less_then, -150>() && !accel<ipass::motion::z_equal_to, 1>();
+
+    static_assert(tilted_backwards({0, -200, 0}, {0, 0, 0}), "tilted and not flat");
+    static_assert(!tilted_backwards({0, -200, 0}, {0, 0, 1}), "tilted but flat");
+    static_assert(!tilted_backwards({0, 0, 0}, {0, 0, 0}), "not tilted");
+}
+
+TEST_CASE("ipass::static_rules match like the runtime rules") {
+    using namespace ipass::static_rules;
+
+    const auto rule = (gyro<ipass::motion::x_greater_then, 10>() || accel<ipass::motion::z_less_then, 0>())
+                      && !gyro<ipass::motion::y_equal_to, 5>();
+
+    ipass::gyro_rule a = {ipass::motion::x_greater_then, 10};
+    ipass::accel_rule b = {ipass::motion::z_less_then, 0};
+    ipass::gyro_rule c = {ipass::motion::y_equal_to, 5};
+    ipass::inverted_motion_rule not_a(a);
+    ipass::inverted_motion_rule not_b(b);
+    auto neither = not_a + not_b;
+    ipass::inverted_motion_rule either(neither);
+    ipass::inverted_motion_rule not_c(c);
+    auto expected = either + not_c;
+
+    ipass::rule_program program;
+    auto adapted = make_rule(rule);
+    REQUIRE(adapted.compile(program));
+
+    ipass::leaf_table table;
+    REQUIRE(program.bind(table));
+    table.build_index();
+
+    for (int16_t x = 9; x <= 11; x++) {
+        for (int16_t y = 4; y <= 6; y++) {
+            for (int16_t z = -1; z <= 1; z++) {
+                const ipass::vector3<int16_t> gyro_data = {x, y, 0};
+                const ipass::vector3<int16_t> accel_data = {0, 0, z};
+                const bool result = expected.match_against(gyro_data, accel_data);
+
+                REQUIRE(rule(gyro_data, accel_data) == result);
+                REQUIRE(adapted.match_against(gyro_data, accel_data) == result);
+                REQUIRE(program.match_against(gyro_data, accel_data) == result);
+                REQUIRE(program.match_against(table.evaluate(gyro_data, accel_data)) == result);
+            }
+        }
+    }
+}
+
+/* Temporal rule tests */
+TEST_CASE("ipass::sequence_rule matches steps in order within the window") {
+    // The conditions are stored in the rule itself, so a copy would point at the original
+    static_assert(!std::is_copy_constructible<ipass::sequence_rule>::value, "no copies");
+    static_assert(!std::is_move_constructible<ipass::duration_rule>::value, "no moves");
+    static_assert(!std::is_copy_assignable<ipass::hysteresis_rule>::value, "no copies");
+
+    ipass::gyro_rule forwards = {ipass::motion::y_greater_then, 150};
+    ipass::gyro_rule backwards = {ipass::motion::y_less_then, -150};
+
+    ipass::sequence_rule rule;
+    REQUIRE(rule.then(forwards));
+    REQUIRE(rule.then(backwards, 300));
+
+    const ipass::vector3<int16_t> accel;
+
+    SECTION("in time") {
+        REQUIRE_FALSE(rule.update({0, 200, 0}, accel, 0));
+        REQUIRE_FALSE(rule.update({0, 200, 0}, accel, 100));
+        REQUIRE_FALSE(rule.update({0, 0, 0}, accel, 200));
+        REQUIRE(rule.update({0, -200, 0}, accel, 400));
+
+        // The sequence starts over after a match
+        REQUIRE_FALSE(rule.update({0, -200, 0}, accel, 450));
+    }
+
+    SECTION("too late") {
+        REQUIRE_FALSE(rule.update({0, 200, 0}, accel, 0));
+        REQUIRE_FALSE(rule.update({0, -200, 0}, accel, 301));
+    }
+
+    SECTION("wrong order") {
+        REQUIRE_FALSE(rule.update({0, -200, 0}, accel, 0));
+        REQUIRE_FALSE(rule.update({0, 200, 0}, accel, 10));
+        REQUIRE(rule.update({0, -200, 0}, accel, 20));
+    }
+}
+
+TEST_CASE("ipass::sequence_rule steps without a window") {
+    ipass::gyro_rule forwards = {ipass::motion::y_greater_then, 150};
+    ipass::gyro_rule backwards = {ipass::motion::y_less_then, -150};
+
+    ipass::sequence_rule rule;
+    REQUIRE(rule.then(forwards));
+    REQUIRE(rule.then(backwards));
+
+    const ipass::vector3<int16_t> accel;
+
+    REQUIRE_FALSE(rule.update({0, 200, 0}, accel, 0));
+    REQUIRE_FALSE(rule.update({0, 0, 0}, accel, 1000000));
+    REQUIRE(rule.update({0, -200, 0}, accel, 60000000));
+}
+
+TEST_CASE("ipass::motion_sensor processes temporal rules") {
+    ipass::test::mock_sensor m;
+
+    ipass::gyro_rule forwards = {ipass::motion::y_greater_then, 150};
+    ipass::gyro_rule backwards = {ipass::motion::y_less_then, -150};
+
+    ipass::sequence_rule rule;
+    rule.then(forwards);
+    rule.then(backwards, 300);
+
+    static int count = 0;
+    REQUIRE(m.when(rule, [](const auto &, const auto &) { count++; }) == 0);
+
+    const int16_t ys[] = {200, 0, -200, 0, 200, 0, 0, -200};
+    const uint_fast64_t times[] = {0, 100, 200, 300, 400, 500, 800, 900};
+
+    for (int i = 0; i < 8; i++) {
+        m.set_gyro({0, ys[i], 0});
+        m.set_timestamp(times[i]);
+        m.process_handlers();
+    }
+
+    REQUIRE(count == 1);
+
+    SECTION("in blocks") {
+        int16_t gyro_y[64] = {};
+        int16_t zero[64] = {};
+        gyro_y[0] = 200;
+        gyro_y[40] = -200;
+        gyro_y[45] = 200;
+        gyro_y[50] = -200;
+
+        const ipass::sample_block block = {
+            {zero, gyro_y, zero},
+            {zero, zero, zero},
+            64, 1000, 10
+        };
+
+        count = 0;
+        m.process_handlers(block);
+
+        REQUIRE(count == 1);
+    }
+}
+
+TEST_CASE("ipass::hysteresis_rule keeps matching until the exit rule matches") {
+    ipass::gyro_rule enter = {ipass::motion::y_less_then, -150};
+    ipass::gyro_rule exit = {ipass::motion::y_greater_then, -120};
+    ipass::hysteresis_rule rule(enter, exit);
+
+    const ipass::vector3<int16_t> accel;
+    const int16_t ys[] = {-140, -151, -140, -149, -130, -119, -140, -151};
+    const bool expected[] = {false, true, true, true, true, false, false, true};
+
+    for (int i = 0; i < 8; i++) {
+        REQUIRE(rule.update({0, ys[i], 0}, accel, i) == expected[i]);
+    }
+}
+
+TEST_CASE("ipass::duration_rule requires the rule to hold") {
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+    ipass::duration_rule rule(tilted, 50);
+
+    const ipass::vector3<int16_t> accel;
+
+    REQUIRE_FALSE(rule.update({200, 0, 0}, accel, 0));
+    REQUIRE_FALSE(rule.update({200, 0, 0}, accel, 40));
+    REQUIRE_FALSE(rule.update({0, 0, 0}, accel, 60));
+    REQUIRE_FALSE(rule.update({200, 0, 0}, accel, 70));
+    REQUIRE_FALSE(rule.update({200, 0, 0}, accel, 110));
+    REQUIRE(rule.update({200, 0, 0}, accel, 120));
+    REQUIRE(rule.update({200, 0, 0}, accel, 130));
+}
+
+TEST_CASE("ipass::motion_sensor refractory period limits calls") {
+    ipass::test::mock_sensor m;
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+
+    static int count = 0;
+    const auto index = m.when(tilted, [](const auto &, const auto &) { count++; });
+    m.set_refractory(index, 100);
+
+    m.set_gyro({200, 0, 0});
+
+    for (uint_fast64_t t = 0; t < 250; t += 10) {
+        m.set_timestamp(t);
+        m.process_handlers();
+    }
+
+    // Called at 0, 100 and 200
+    REQUIRE(count == 3);
+
+    SECTION("in blocks") {
+        int16_t gyro_x[40];
+        int16_t zero[40] = {};
+
+        for (auto &x : gyro_x) {
+            x = 200;
+        }
+
+        const ipass::sample_block block = {
+            {gyro_x, zero, zero},
+            {zero, zero, zero},
+            40, 300, 10
+        };
+
+        count = 0;
+        m.process_handlers(block);
+
+        // Called at 300, 400, 500 and 600
+        REQUIRE(count == 4);
+    }
+}
+
+TEST_CASE("ipass::motion_sensor edge triggered handlers") {
+    ipass::test::mock_sensor m;
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+
+    static int rising = 0;
+    static int falling = 0;
+    static int both = 0;
+
+    m.when(tilted, [](const auto &, const auto &) { rising++; }, ipass::trigger_mode::rising);
+    m.when(tilted, [](const auto &, const auto &) { falling++; }, ipass::trigger_mode::falling);
+    m.when(tilted, [](const auto &, const auto &) { both++; }, ipass::trigger_mode::both);
+
+    const int16_t xs[] = {0, 200, 200, 200, 0, 0, 200, 0};
+
+    for (auto x : xs) {
+        m.set_gyro({x, 0, 0});
+        m.process_handlers();
+    }
+
+    REQUIRE(rising == 2);
+    REQUIRE(falling == 2);
+    REQUIRE(both == 4);
+
+    SECTION("in blocks") {
+        // The last sample above did not match, the block starts matching
+        int16_t gyro_x[70] = {};
+        int16_t zero[70] = {};
+
+        // Matching runs crossing both chunk boundaries
+        for (int i = 0; i < 40; i++) {
+            gyro_x[i] = 200;
+        }
+
+        for (int i = 60; i < 70; i++) {
+            gyro_x[i] = 200;
+        }
+
+        const ipass::sample_block block = {
+            {gyro_x, zero, zero},
+            {zero, zero, zero},
+            70, 0, 10
+        };
+
+        rising = falling = both = 0;
+        m.process_handlers(block);
+
+        REQUIRE(rising == 2);
+        REQUIRE(falling == 1);
+        REQUIRE(both == 3);
+
+        // The block ended matching, so the next sample falls
+        m.set_gyro({0, 0, 0});
+        m.process_handlers();
+
+        REQUIRE(rising == 2);
+        REQUIRE(falling == 2);
+        REQUIRE(both == 4);
+    }
+}
+
+/* Vector rule tests */
+TEST_CASE("ipass::magnitude_rule compares the length without overflow") {
+    ipass::magnitude_rule shaken(ipass::rule_source::accel, ipass::comparison::greater_then, 32768);
+    ipass::magnitude_rule still(ipass::rule_source::gyro, ipass::comparison::less_then, 50);
+    ipass::magnitude_rule exact(ipass::rule_source::gyro, ipass::comparison::equal_to, 5);
+
+    const ipass::vector3<int16_t> zero;
+
+    REQUIRE_FALSE(shaken.match_against(zero, {16384, 0, 16384}));
+    REQUIRE(shaken.match_against(zero, {30000, 0, 16384}));
+    REQUIRE(shaken.match_against(zero, {-32768, -32768, -32768}));
+
+    REQUIRE(still.match_against({20, -20, 20}, zero));
+    REQUIRE_FALSE(still.match_against({30, -30, 40}, zero));
+
+    REQUIRE(exact.match_against({3, 0, -4}, zero));
+    REQUIRE_FALSE(exact.match_against({3, 1, -4}, zero));
+}
+
+TEST_CASE("ipass::dot_rule compares the projection on a direction") {
+    ipass::dot_rule forwards(ipass::rule_source::gyro, {0, 256, 0}, ipass::comparison::greater_then, 150 * 256);
+
+    const ipass::vector3<int16_t> zero;
+
+    REQUIRE(forwards.match_against({500, 151, -500}, zero));
+    REQUIRE_FALSE(forwards.match_against({500, 150, -500}, zero));
+
+    ipass::dot_rule diagonal(ipass::rule_source::gyro, {32767, 32767, 32767}, ipass::comparison::less_then, 0);
+
+    REQUIRE(diagonal.match_against({-32768, -32768, -32768}, zero));
+    REQUIRE_FALSE(diagonal.match_against({32767, 32767, 32767}, zero));
+}
+
+TEST_CASE("ipass::cone_rule matches like the floating point angle") {
+    const int16_t cosines[] = {30792, 16384, 0, -16384};
+    const ipass::vector3<int16_t> axes[] = {{0, 0, 1}, {1000, -1000, 0}, {-3, 5, 7}};
+    const ipass::vector3<int16_t> zero;
+
+    for (auto cosine : cosines) {
+        for (const auto &axis : axes) {
+            ipass::cone_rule cone(ipass::rule_source::accel, axis, cosine);
+
+            // The lengths in double, the squares of the components overflow an int
+            const double axis_length = std::sqrt(double(axis.x) * axis.x + double(axis.y) * axis.y
+                                                 + double(axis.z) * axis.z);
+
+            int points = 0;
+            int checked = 0;
+
+            for (int x = -32768; x < 32768; x += 4099) {
+                for (int y = -32768; y < 32768; y += 4751) {
+                    for (int z = -32768; z < 32768; z += 5003) {
+                        const ipass::vector3<int16_t> accel = {int16_t(x), int16_t(y), int16_t(z)};
+
+                        const double length = std::sqrt(double(x) * x + double(y) * y + double(z) * z);
+                        const double angle = (double(x) * axis.x + double(y) * axis.y + double(z) * axis.z)
+                                             / (length * axis_length);
+                        const double limit = cosine / 32768.0;
+
+                        REQUIRE(std::isfinite(angle));
+                        points++;
+
+                        // Allow for the rounding of the scaled axis
+                        if (angle > limit + 0.005) {
+                            REQUIRE(cone.match_against(zero, accel));
+                            checked++;
+                        } else if (angle < limit - 0.005) {
+                            REQUIRE_FALSE(cone.match_against(zero, accel));
+                            checked++;
+                        }
+                    }
+                }
+            }
+
+            // Only the points on the edge of the cone are left out
+            REQUIRE(points == 16 * 14 * 14);
+            REQUIRE(checked > points * 98 / 100);
+        }
+    }
+
+    ipass::cone_rule none(ipass::rule_source::accel, zero, 0);
+
+    REQUIRE_FALSE(none.match_against(zero, {0, 0, 100}));
+    REQUIRE_FALSE(ipass::cone_rule(ipass::rule_source::accel, {0, 0, 1}, 0).match_against(zero, zero));
+}
+
+TEST_CASE("ipass::motion_sensor processes vector rules") {
+    ipass::test::mock_sensor m;
+    ipass::cone_rule flat(ipass::rule_source::accel, {0, 0, 1}, 30792);
+    ipass::gyro_rule turning = {ipass::motion::z_greater_then, 100};
+    auto rule = flat + turning;
+
+    static int count = 0;
+    REQUIRE(m.when(rule, [](const auto &, const auto &) { count++; }) >= 0);
+
+    m.set_gyro({0, 0, 200});
+    m.set_accel({1000, 0, 16384});
+    m.process_handlers();
+
+    m.set_accel({16384, 0, 16384});
+    m.process_handlers();
+
+    REQUIRE(count == 1);
+}
+
+/* Rule arena tests */
+TEST_CASE("ipass::rule_arena matches like the reference rules") {
+    ipass::fixed_rule_arena<16> arena;
+
+    ipass::gyro_rule backwards = {ipass::motion::y_less_then, -150};
+    ipass::accel_rule flat = {ipass::motion::z_equal_to, 1};
+    ipass::inverted_motion_rule not_flat(flat);
+    ipass::gyro_rule forwards = {ipass::motion::y_greater_then, 150};
+    auto tilted = backwards + not_flat;
+    auto reference = tilted | forwards;
+
+    const auto rule = arena.any(
+            arena.all(arena.gyro(ipass::motion::y_less_then, -150),
+                      arena.invert(arena.accel(ipass::motion::z_equal_to, 1))),
+            arena.gyro(ipass::motion::y_greater_then, 150));
+
+    REQUIRE(rule >= 0);
+    REQUIRE(arena.length() == 6);
+
+    ipass::rule_program program;
+    REQUIRE(arena.compile(rule, program));
+
+    const int16_t ys[] = {-200, -150, 0, 150, 200};
+    const int16_t zs[] = {0, 1, 2};
+
+    for (auto y : ys) {
+        for (auto z : zs) {
+            const bool expected = reference.match_against({0, y, 0}, {0, 0, z});
+
+            REQUIRE(arena.match_against(rule, {0, y, 0}, {0, 0, z}) == expected);
+            REQUIRE(program.match_against({0, y, 0}, {0, 0, z}) == expected);
+        }
+    }
+}
+
+TEST_CASE("ipass::rule_arena reports failures as invalid handles") {
+    ipass::fixed_rule_arena<3> arena;
+
+    const auto a = arena.gyro(ipass::motion::x_greater_then, 0);
+    const auto b = arena.gyro(ipass::motion::x_less_then, 100);
+    const auto both = arena.all(a, b);
+
+    REQUIRE(both == 2);
+    REQUIRE(arena.invert(both) == -1);
+    REQUIRE(arena.all(-1, a) == -1);
+    REQUIRE(arena.invert(5) == -1);
+    REQUIRE_FALSE(arena.match_against(-1, {50, 0, 0}, {}));
+
+    ipass::rule_program program;
+    REQUIRE_FALSE(arena.compile(-1, program));
+
+    SECTION("rewind drops newer nodes") {
+        const auto mark = arena.mark();
+        REQUIRE(mark == 3);
+
+        arena.rewind(1);
+        REQUIRE(arena.length() == 1);
+        REQUIRE_FALSE(arena.match_against(both, {50, 0, 0}, {}));
+        REQUIRE(arena.match_against(a, {50, 0, 0}, {}));
+
+        arena.clear();
+        REQUIRE(arena.length() == 0);
+    }
+}
+
+TEST_CASE("ipass::motion_sensor registers rules from an arena") {
+    ipass::test::mock_sensor m;
+    ipass::fixed_rule_arena<8> arena;
+
+    static int count = 0;
+
+    {
+        const auto mark = arena.mark();
+        const auto rule = arena.all(arena.gyro(ipass::motion::x_greater_then, 100),
+                                    arena.accel(ipass::motion::z_greater_then, 0));
+
+        ipass::rule_program program;
+        REQUIRE(arena.compile(rule, program));
+        REQUIRE(m.when(program, [](const auto &, const auto &) { count++; }) >= 0);
+
+        // The sensor keeps its own copy, the arena can be reused
+        arena.rewind(mark);
+    }
+
+    auto turning = arena.get(arena.gyro(ipass::motion::z_greater_then, 100));
+    REQUIRE(m.when(turning, [](const auto &, const auto &) { count += 10; }) >= 0);
+
+    arena.clear();
+
+    m.set_gyro({200, 0, 200});
+    m.set_accel({0, 0, 1});
+    m.process_handlers();
+
+    REQUIRE(count == 11);
+}
+
+/* Rule set tests */
+TEST_CASE("ipass::rule_set round trips an arena") {
+    ipass::fixed_rule_arena<16> arena;
+
+    const auto flat = arena.accel(ipass::motion::z_equal_to, 1);
+    const auto backwards = arena.all(arena.gyro(ipass::motion::y_less_then, -150), arena.invert(flat));
+    const auto right = arena.gyro(ipass::motion::x_greater_then, 120);
+
+    const ipass::rule_set_binding bindings[] = {
+        {uint16_t(backwards), 0, ipass::trigger_mode::level},
+        {uint16_t(right), 1, ipass::trigger_mode::rising}
+    };
+
+    uint8_t buffer[64];
+    const uint32_t size = ipass::rule_set::save(arena, bindings, 2, buffer, sizeof(buffer));
+
+    REQUIRE(size == 8 + 5 * 6 + 2 * 4);
+    REQUIRE(ipass::rule_set::save(arena, bindings, 2, buffer, size - 1) == 0);
+
+    const ipass::rule_set set(buffer, size);
+    REQUIRE(set.is_valid());
+    REQUIRE(set.get_node_count() == 5);
+    REQUIRE(set.get_binding_count() == 2);
+    REQUIRE(set.get_binding(1).rule == right);
+    REQUIRE(set.get_binding(1).mode == ipass::trigger_mode::rising);
+
+    // Load behind an existing node, so the handles are offset
+    ipass::fixed_rule_arena<16> loaded;
+    loaded.gyro(ipass::motion::none, 0);
+
+    const auto base = set.load(loaded);
+    REQUIRE(base == 1);
+    REQUIRE(loaded.length() == 6);
+
+    const int16_t ys[] = {-200, 0};
+    const int16_t zs[] = {0, 1};
+
+    for (auto y : ys) {
+        for (auto z : zs) {
+            REQUIRE(loaded.match_against(base + backwards, {0, y, 0}, {0, 0, z})
+                    == arena.match_against(backwards, {0, y, 0}, {0, 0, z}));
+        }
+    }
+
+    SECTION("bind registers the handlers") {
+        ipass::test::mock_sensor m;
+
+        static int backwards_count = 0;
+        static int right_count = 0;
+
+        const ipass::motion_handler::func functions[] = {
+            [](const auto &, const auto &) { backwards_count++; },
+            [](const auto &, const auto &) { right_count++; }
+        };
+
+        REQUIRE(set.bind(m, loaded, base, functions, 2));
+
+        m.set_gyro({200, -200, 0});
+        m.set_accel({0, 0, 0});
+        m.process_handlers();
+        m.process_handlers();
+
+        REQUIRE(backwards_count == 2);
+        REQUIRE(right_count == 1);
+
+        // A missing handler registers nothing
+        ipass::test::mock_sensor other;
+        REQUIRE_FALSE(set.bind(other, loaded, base, functions, 1));
+
+        backwards_count = 0;
+        other.set_gyro({200, -200, 0});
+        other.process_handlers();
+
+        REQUIRE(backwards_count == 0);
+    }
+}
+
+TEST_CASE("ipass::rule_set rejects malformed data") {
+    uint8_t data[] = {
+        'I', 'P', 'R', 'S', 1, 0, 2, 0,
+        0, 0, 0, 1, 100, 0,
+        1, 0, 0, 0, 1, 0
+    };
+
+    ipass::fixed_rule_arena<4> arena;
+
+    SECTION("operands have to precede the node") {
+        REQUIRE(ipass::rule_set(data, sizeof(data)).is_valid());
+        REQUIRE(ipass::rule_set(data, sizeof(data)).load(arena) == -1);
+        REQUIRE(arena.length() == 0);
+
+        data[18] = 0;
+        REQUIRE(ipass::rule_set(data, sizeof(data)).load(arena) == 0);
+        REQUIRE(arena.length() == 2);
+    }
+
+    SECTION("the header is checked") {
+        REQUIRE_FALSE(ipass::rule_set(data, sizeof(data) - 1).is_valid());
+
+        data[4] = 2;
+        REQUIRE_FALSE(ipass::rule_set(data, sizeof(data)).is_valid());
+
+        data[4] = 1;
+        data[0] = 'X';
+        REQUIRE(ipass::rule_set(data, sizeof(data)).load(arena) == -1);
+    }
+
+    SECTION("leaves have to be valid") {
+        data[11] = 42;
+        data[18] = 0;
+        REQUIRE(ipass::rule_set(data, sizeof(data)).load(arena) == -1);
+    }
+}
+
+/* Rule parser tests */
+TEST_CASE("ipass::rule_parser parses expressions like the reference rules") {
+    ipass::fixed_rule_arena<32> arena;
+    ipass::rule_parser parser(arena);
+
+    ipass::gyro_rule backwards = {ipass::motion::y_less_then, -150};
+    ipass::accel_rule flat = {ipass::motion::z_equal_to, 1};
+    ipass::inverted_motion_rule not_flat(flat);
+    ipass::gyro_rule right = {ipass::motion::x_greater_then, 120};
+    auto tilted = backwards + not_flat;
+    auto reference = tilted | right;
+
+    const auto rule = parser.parse("gyro.y < -150 && !(accel.z == 1) || 120 < gyro.x");
+    REQUIRE(rule >= 0);
+
+    const int16_t values[] = {-200, -150, -149, 0, 1, 120, 121};
+
+    for (auto x : values) {
+        for (auto y : values) {
+            for (auto z : values) {
+                REQUIRE(arena.match_against(rule, {x, y, 0}, {0, 0, z})
+                        == reference.match_against({x, y, 0}, {0, 0, z}));
+            }
+        }
+    }
+
+    SECTION("other comparisons") {
+        const auto other = parser.parse("gyro.x <= 5 && accel.y >= -5 && gyro.z != 0");
+        REQUIRE(other >= 0);
+
+        for (auto x : values) {
+            for (auto y : values) {
+                const bool expected = x <= 5 && y >= -5 && x != 0;
+                REQUIRE(arena.match_against(other, {x, 0, x}, {0, y, 0}) == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE("ipass::rule_parser shares sub-expressions") {
+    ipass::fixed_rule_arena<32> arena;
+    ipass::rule_parser parser(arena);
+
+    const auto first = parser.parse("gyro.x > 10 && accel.z == 1");
+    REQUIRE(arena.length() == 3);
+
+    // The same rule with the operands swapped is the same node
+    REQUIRE(parser.parse("accel.z == 1 && gyro.x > 10") == first);
+    REQUIRE(arena.length() == 3);
+
+    // Shared leaves are reused
+    REQUIRE(parser.parse("(gyro.x > 10 && accel.z == 1) || gyro.x > 10") >= 0);
+    REQUIRE(arena.length() == 4);
+
+    // Double negations are removed, without leaving the inner inverse behind
+    REQUIRE(parser.parse("!!(gyro.x > 10)") == 0);
+    REQUIRE(arena.length() == 4);
+
+    REQUIRE(parser.parse("!(gyro.y != 5) || !!!(gyro.x > 10)") >= 0);
+    REQUIRE(arena.length() == 7);
+
+    // An existing inverse stays when a double negation reuses it
+    const auto inverse = parser.parse("!(gyro.y == 5)");
+    REQUIRE(arena.length() == 8);
+    REQUIRE(parser.parse("gyro.z > 1 && !!!(gyro.y == 5)") >= 0);
+    REQUIRE(arena.length() == 10);
+    REQUIRE(arena[inverse].kind == ipass::rule_node_kind::invert);
+}
+
+TEST_CASE("ipass::rule_parser folds constants") {
+    ipass::fixed_rule_arena<32> arena;
+    ipass::rule_parser parser(arena);
+
+    const ipass::vector3<int16_t> zero;
+
+    // Only the leaf remains
+    REQUIRE(parser.parse("true && gyro.x > 10 || false") == 0);
+    REQUIRE(arena.length() == 1);
+
+    // A rule and its inverse
+    const auto never = parser.parse("gyro.x > 10 && !(gyro.x > 10)");
+    REQUIRE(never >= 0);
+    REQUIRE_FALSE(arena.match_against(never, {20, 0, 0}, zero));
+    REQUIRE_FALSE(arena.match_against(never, {0, 0, 0}, zero));
+
+    // Comparisons outside of the range of an axis
+    const auto always = parser.parse("gyro.x < 40000 && accel.y >= -32768");
+    REQUIRE(always >= 0);
+    REQUIRE(arena[always].kind == ipass::rule_node_kind::leaf);
+    REQUIRE(arena.match_against(always, {-32768, 0, 0}, {0, -32768, 0}));
+
+    // Folded to the same constant as the rule above, nothing is added
+    const auto length = arena.length();
+    const auto impossible = parser.parse("gyro.z > 32767 && (accel.x == 3 || accel.y == 4)");
+    REQUIRE(impossible == never);
+    REQUIRE(arena.length() == length);
+}
+
+TEST_CASE("ipass::rule_parser converts numbers with a unit") {
+    ipass::fixed_rule_arena<32> arena;
+    ipass::rule_parser parser(arena);
+
+    const auto rule = parser.parse("gyro.y < -150 dps && !(accel.z > 0.9g)");
+    REQUIRE(rule >= 0);
+
+    const int16_t tilted = ipass::gyro_format::from_int(-151);
+    const int16_t flat = ipass::accel_format::from_int(1);
+
+    REQUIRE(arena.match_against(rule, {0, tilted, 0}, {0, 0, 0}));
+    REQUIRE_FALSE(arena.match_against(rule, {0, tilted, 0}, {0, 0, flat}));
+    REQUIRE_FALSE(arena.match_against(rule, {0, -150 * 16, 0}, {0, 0, 0}));
+
+    // The same leaves as the converted integers
+    const auto length = arena.length();
+    REQUIRE(parser.parse("-2400 > gyro.y && !(accel.z > 1843)") == rule);
+    REQUIRE(arena.length() == length);
+
+    // Decimals need a unit, and the unit has to match the source
+    REQUIRE(parser.parse("accel.z > 0.9") == -1);
+    REQUIRE(parser.parse("accel.z > 1 dps") == -1);
+    REQUIRE(parser.parse("gyro.x > 10 g") == -1);
+    REQUIRE(parser.parse("gyro.x > 10 deg") == -1);
+
+    // Beyond the range of the format, so it always matches
+    const auto always = parser.parse("accel.x < 16 g");
+    REQUIRE(always >= 0);
+    REQUIRE(arena.match_against(always, {0, 0, 0}, {INT16_MAX, 0, 0}));
+}
+
+TEST_CASE("ipass::rule_parser reports errors") {
+    ipass::fixed_rule_arena<32> arena;
+    ipass::rule_parser parser(arena);
+
+    REQUIRE(parser.parse("gyro.x > 10 &&") == -1);
+    REQUIRE(parser.parse("gyro.w > 10") == -1);
+    REQUIRE(parser.parse("gyros.x > 10") == -1);
+    REQUIRE(parser.parse("(gyro.x > 10") == -1);
+    REQUIRE(parser.parse("gyro.x > 10 & gyro.y < 4") == -1);
+    REQUIRE(parser.get_error() == 12);
+    REQUIRE(parser.parse(nullptr) == -1);
+
+    // Nothing is left behind
+    REQUIRE(arena.length() == 0);
+
+    SECTION("full arena") {
+        ipass::fixed_rule_arena<2> small;
+        ipass::rule_parser limited(small);
+
+        REQUIRE(limited.parse("gyro.x > 1 && gyro.y > 1") == -1);
+        REQUIRE(small.length() == 0);
+    }
+}
+
+/* Handler table tests */
+TEST_CASE("ipass::handler_table keeps ids stable when removing") {
+    ipass::fixed_handler_table<4> table;
+    const ipass::motion_handler handler({}, [](const auto &, const auto &) {});
+
+    const auto a = table.add(handler);
+    const auto b = table.add(handler);
+    const auto c = table.add(handler);
+    const auto d = table.add(handler);
+
+    REQUIRE(table.is_full());
+    REQUIRE(table.add(handler) == -1);
+
+    // The last handler is moved into the freed position
+    REQUIRE(table.remove(b));
+    REQUIRE(table.length() == 3);
+    REQUIRE(table.get_id(1) == d);
+    REQUIRE(table.find(b) == nullptr);
+    REQUIRE(table.find(d) == table.begin() + 1);
+    REQUIRE(table.find(a) == table.begin());
+    REQUIRE(table.find(c) == table.begin() + 2);
+
+    REQUIRE_FALSE(table.remove(b));
+    REQUIRE_FALSE(table.remove(-1));
+    REQUIRE_FALSE(table.remove(4));
+
+    // The freed id is reused
+    REQUIRE(table.add(handler) == b);
+    REQUIRE(table.get_id(3) == b);
+
+    table.clear();
+    REQUIRE(table.length() == 0);
+    REQUIRE(table.begin() == table.end());
+}
+
+TEST_CASE("ipass::motion_sensor uses a larger handler table") {
+    ipass::test::mock_sensor m;
+    ipass::fixed_handler_snapshot<64> table;
+
+    static int count = 0;
+    const auto increment = [](const auto &, const auto &) { count++; };
+
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+
+    REQUIRE(m.when(tilted, increment) >= 0);
+    REQUIRE_FALSE(m.use_handlers(table));
+
+    ipass::test::mock_sensor large;
+    REQUIRE(large.use_handlers(table));
+
+    int16_t ids[64];
+
+    for (auto &id : ids) {
+        id = large.when(tilted, increment);
+        REQUIRE(id >= 0);
+    }
+
+    REQUIRE(large.when(tilted, increment) == -1);
+    REQUIRE(large.get_handler_count() == 64);
+
+    large.set_gyro({200, 0, 0});
+    large.process_handlers();
+    REQUIRE(count == 64);
+
+    for (int i = 0; i < 64; i += 2) {
+        large.remove_handler(ids[i]);
+    }
+
+    // The remaining ids still refer to their handlers
+    large.set_refractory(ids[1], 1000);
+    large.remove_handler(ids[3]);
+    REQUIRE(large.get_handler_count() == 31);
+
+    count = 0;
+    large.set_timestamp(5000);
+    large.process_handlers();
+    large.set_timestamp(5010);
+    large.process_handlers();
+
+    // The handler with a refractory period is only called once
+    REQUIRE(count == 31 + 30);
+}
+
+TEST_CASE("ipass::motion_sensor matches rules that do not fit the leaf table") {
+    ipass::test::mock_sensor m;
+    ipass::fixed_handler_snapshot<80> table;
+    REQUIRE(m.use_handlers(table));
+
+    static int count;
+    count = 0;
+    const auto increment = [](const auto &, const auto &) { count++; };
+
+    // Every rule has a leaf of its own, so the last ones do not fit
+    int16_t ids[80];
+
+    for (int16_t i = 0; i < 80; i++) {
+        ipass::gyro_rule rule = {ipass::motion::x_greater_then, i};
+        ids[i] = m.when(rule, increment);
+        REQUIRE(ids[i] >= 0);
+    }
+
+    m.set_gyro({70, 0, 0});
+    m.process_handlers();
+    REQUIRE(count == 70);
+
+    SECTION("a block of samples") {
+        ipass::motion_sample samples[40];
+
+        for (int i = 0; i < 40; i++) {
+            samples[i] = {{int16_t(i % 2 == 0 ? 75 : 10), 0, 0}, {}, 0, uint_fast64_t(i)};
+        }
+
+        count = 0;
+        m.process_handlers(samples, 40);
+        REQUIRE(count == 20 * 75 + 20 * 10);
+    }
+
+    SECTION("removing handlers makes room") {
+        for (int i = 0; i < 20; i++) {
+            m.remove_handler(ids[i]);
+        }
+
+        count = 0;
+        m.process_handlers();
+        REQUIRE(count == 50);
+    }
+}
+
+TEST_CASE("ipass::motion_sensor passes the context to callbacks") {
+    ipass::test::mock_sensor m;
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+    ipass::sequence_rule twice;
+    twice.then(tilted);
+
+    struct counter {
+        int calls = 0;
+        int16_t last = 0;
+    };
+
+    counter first, second, third;
+
+    const auto count = [](const auto &gyro, const auto &, void *context) {
+        auto *target = static_cast<counter *>(context);
+        target->calls++;
+        target->last = gyro.x;
+    };
+
+    REQUIRE(m.when(tilted, count, &first) >= 0);
+    REQUIRE(m.when(tilted, count, &second, ipass::trigger_mode::rising) >= 0);
+    REQUIRE(m.when(twice, count, &third) >= 0);
+
+    m.set_gyro({200, 0, 0});
+    m.process_handlers();
+    m.set_gyro({300, 0, 0});
+    m.process_handlers();
+
+    REQUIRE(first.calls == 2);
+    REQUIRE(first.last == 300);
+    REQUIRE(second.calls == 1);
+    REQUIRE(second.last == 200);
+    REQUIRE(third.calls == 2);
+
+    SECTION("in blocks") {
+        int16_t gyro_x[40];
+        int16_t zero[40] = {};
+
+        for (int i = 0; i < 40; i++) {
+            gyro_x[i] = int16_t(101 + i);
+        }
+
+        const ipass::sample_block block = {
+            {gyro_x, zero, zero},
+            {zero, zero, zero},
+            40, 0, 10
+        };
+
+        m.process_handlers(block);
+
+        REQUIRE(first.calls == 42);
+        REQUIRE(first.last == 140);
+        REQUIRE(second.calls == 1);
+    }
+}
+
+TEST_CASE("ipass::motion_sensor decorators take over the handler storage") {
+    static int count;
+    count = 0;
+    const auto increment = [](const auto &, const auto &) { count++; };
+
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+
+    ipass::test::mock_sensor base;
+    base.set_gyro({200, 0, 0});
+
+    // A decorator does not carry handler storage of its own
+    static_assert(sizeof(ipass::gyro_corrected_motion_sensor) < sizeof(ipass::leaf_table), "no storage");
+
+    SECTION("on the sensor itself") {
+        REQUIRE(base.when(tilted, increment) >= 0);
+
+        base.process_handlers();
+        REQUIRE(count == 1);
+
+        // The slave is in use, so the decorator has no storage
+        ipass::gyro_corrected_motion_sensor plain(base, {0, 0, 0});
+
+        REQUIRE(plain.when(tilted, increment) == -1);
+        REQUIRE(plain.get_handler_count() == 0);
+        REQUIRE(plain.get_handler_id(0) == -1);
+        REQUIRE(plain.get_overruns(0) == 0);
+
+        plain.remove_handler(0);
+        plain.set_period(0, 100);
+        plain.process_handlers();
+        REQUIRE(count == 1);
+    }
+
+    SECTION("on a decorator") {
+        ipass::gyro_corrected_motion_sensor corrected(base, {50, 0, 0});
+        ipass::cached_motion_sensor cached(corrected);
+
+        REQUIRE(cached.when(tilted, increment) >= 0);
+        REQUIRE(base.when(tilted, increment) == -1);
+        REQUIRE(corrected.when(tilted, increment) == -1);
+
+        cached.refresh();
+        cached.process_handlers();
+        REQUIRE(count == 1);
+
+        // The correction applies
+        base.set_gyro({120, 0, 0});
+        cached.refresh();
+        cached.process_handlers();
+        REQUIRE(count == 1);
+    }
+
+    SECTION("with storage of its own") {
+        ipass::with_handlers<ipass::gyro_corrected_motion_sensor, 2> sensor(base, ipass::vector3<int16_t>{50, 0, 0});
+
+        REQUIRE(sensor.when(tilted, increment) >= 0);
+        REQUIRE(sensor.when(tilted, increment) >= 0);
+        REQUIRE(sensor.when(tilted, increment) == -1);
+
+        // The slave keeps its own
+        REQUIRE(base.when(tilted, increment) >= 0);
+
+        sensor.process_handlers();
+        REQUIRE(count == 2);
+    }
+}
+
+/* Event queue tests */
+TEST_CASE("ipass::event_queue pushes and pops in order") {
+    ipass::fixed_event_queue<4> queue;
+    ipass::motion_event event = {};
+
+    REQUIRE(queue.get_capacity() == 4);
+    REQUIRE(queue.depth() == 0);
+    REQUIRE_FALSE(queue.pop(event));
+
+    for (int16_t i = 0; i < 4; i++) {
+        event.handler = i;
+        REQUIRE(queue.push(event));
+    }
+
+    REQUIRE(queue.depth() == 4);
+
+    // A full queue drops the event and counts it
+    event.handler = 4;
+    REQUIRE_FALSE(queue.push(event));
+    REQUIRE_FALSE(queue.dispatch(event));
+    REQUIRE(queue.dropped() == 2);
+
+    for (int16_t i = 0; i < 4; i++) {
+        REQUIRE(queue.pop(event));
+        REQUIRE(event.handler == i);
+    }
+
+    REQUIRE(queue.depth() == 0);
+    REQUIRE_FALSE(queue.pop(event));
+
+    // Wrapping around the storage
+    for (int16_t i = 0; i < 10; i++) {
+        event.handler = i;
+        REQUIRE(queue.push(event));
+        REQUIRE(queue.pop(event));
+        REQUIRE(event.handler == i);
+    }
+
+    REQUIRE(queue.dropped() == 2);
+}
+
+TEST_CASE("ipass::motion_sensor dispatches handlers to a queue") {
+    ipass::test::mock_sensor m;
+    ipass::fixed_event_queue<64> queue;
+
+    static int count;
+    count = 0;
+    const auto increment = [](const auto &, const auto &) { count++; };
+
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+    ipass::gyro_rule still = {ipass::motion::x_less_then, 100};
+
+    m.when(still, increment);
+    const auto id = m.when(tilted, increment);
+
+    m.set_dispatcher(&queue);
+    m.set_gyro({200, 0, 0});
+    m.set_timestamp(1234);
+    m.process_handlers();
+
+    // The handler is not called while processing
+    REQUIRE(count == 0);
+    REQUIRE(queue.depth() == 1);
+
+    ipass::motion_event event = {};
+    REQUIRE(queue.pop(event));
+    REQUIRE(event.handler == id);
+    REQUIRE(event.timestamp == 1234);
+    REQUIRE(event.gyro == ipass::vector3<int16_t>(200, 0, 0));
+
+    event.call();
+    REQUIRE(count == 1);
+
+    SECTION("in blocks") {
+        int16_t gyro_x[4] = {200, 0, 300, 0};
+        int16_t zero[4] = {};
+
+        const ipass::sample_block block = {
+            {gyro_x, zero, zero},
+            {zero, zero, zero},
+            4, 5000, 10
+        };
+
+        m.process_handlers(block);
+        REQUIRE(queue.depth() == 4);
+
+        REQUIRE(queue.pop(event));
+        REQUIRE(event.handler == id);
+        REQUIRE(event.timestamp == 5000);
+
+        REQUIRE(queue.pop(event));
+        REQUIRE(event.handler != id);
+        REQUIRE(event.timestamp == 5010);
+
+        REQUIRE(queue.pop(event));
+        REQUIRE(event.gyro.x == 300);
+        REQUIRE(event.timestamp == 5020);
+    }
+
+    SECTION("directly again") {
+        m.set_dispatcher(nullptr);
+        m.process_handlers();
+
+        REQUIRE(count == 2);
+        REQUIRE(queue.depth() == 0);
+    }
+}
+
+#if defined(__linux__)
+
+TEST_CASE("ipass::worker_pool runs dispatched handlers") {
+    ipass::fixed_event_queue<256> queue;
+    ipass::worker_pool pool(queue);
+
+    static std::atomic<int> count(0);
+    const auto increment = [](const auto &, const auto &) { count++; };
+
+    REQUIRE_FALSE(pool.start(0));
+    REQUIRE_FALSE(pool.start(ipass::worker_pool::max_workers + 1));
+    REQUIRE(pool.start(3));
+    REQUIRE_FALSE(pool.start(1));
+    REQUIRE(pool.get_worker_count() == 3);
+
+    ipass::test::mock_sensor m;
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+
+    m.when(tilted, increment);
+    m.set_dispatcher(&pool);
+    m.set_gyro({200, 0, 0});
+
+    int dispatched = 0;
+
+    for (int i = 0; i < 1000; i++) {
+        m.process_handlers();
+        dispatched++;
+    }
+
+    pool.stop();
+
+    REQUIRE(pool.get_worker_count() == 0);
+    REQUIRE(uint32_t(count) + queue.dropped() == uint32_t(dispatched));
+    REQUIRE(pool.handled() == uint32_t(count));
+    REQUIRE(queue.depth() == 0);
+}
+
+#endif
+
+/* Handler snapshot tests */
+TEST_CASE("ipass::motion_sensor updates handlers through a spare snapshot") {
+    ipass::test::mock_sensor m;
+    ipass::fixed_handler_snapshot<ipass::motion_sensor::default_handler_count> spare;
+    ipass::fixed_handler_snapshot<4> small;
+
+    static int count;
+    count = 0;
+    const auto increment = [](const auto &, const auto &) { count++; };
+
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+    ipass::gyro_rule still = {ipass::motion::x_less_then, 100};
+
+    REQUIRE_FALSE(m.use_snapshots(small));
+    REQUIRE(m.use_snapshots(spare));
+    REQUIRE_FALSE(m.use_snapshots(spare));
+
+    ipass::fixed_handler_snapshot<16> table;
+    REQUIRE_FALSE(m.use_handlers(table));
+
+    const auto first = m.when(tilted, increment, ipass::trigger_mode::rising);
+    const auto second = m.when(still, increment);
+    REQUIRE(first >= 0);
+    REQUIRE(second >= 0);
+    REQUIRE(m.get_handler_count() == 2);
+
+    m.set_gyro({200, 0, 0});
+    m.process_handlers();
+    REQUIRE(count == 1);
+
+    // The state of a handler is kept when the handlers are copied
+    const auto third = m.when(still, increment);
+    m.process_handlers();
+    REQUIRE(count == 1);
+
+    m.remove_handler(second);
+    REQUIRE(m.get_handler_count() == 2);
+    REQUIRE(m.get_handler_id(0) == first);
+    REQUIRE(m.get_handler_id(1) == third);
+
+    m.set_gyro({0, 0, 0});
+    m.process_handlers();
+    REQUIRE(count == 2);
+
+    m.set_refractory(third, 1000);
+    m.set_timestamp(10);
+    m.process_handlers();
+    REQUIRE(count == 2);
+
+    m.set_gyro({200, 0, 0});
+    m.process_handlers();
+    REQUIRE(count == 3);
+
+    // Freed ids are reused, the same way in both snapshots
+    REQUIRE(m.when(still, increment) == second);
+}
+
+#if defined(__linux__)
+
+TEST_CASE("ipass::motion_sensor registers handlers while processing") {
+    ipass::test::mock_sensor m;
+    ipass::fixed_handler_snapshot<ipass::motion_sensor::default_handler_count> spare;
+
+    static std::atomic<int> count(0);
+    const auto increment = [](const auto &, const auto &) { count++; };
+
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+    ipass::accel_rule flat = {ipass::motion::z_greater_then, 0};
+
+    REQUIRE(m.use_snapshots(spare));
+
+    const auto permanent = m.when(tilted, increment);
+    REQUIRE(permanent >= 0);
+
+    m.set_gyro({200, 0, 0});
+
+    std::atomic<bool> running(true);
+    std::atomic<int> processed(0);
+
+    std::thread sampling([&]() {
+        while (running) {
+            m.process_handlers();
+            processed++;
+        }
+    });
+
+    for (int i = 0; i < 2000; i++) {
+        const auto id = m.when(flat, increment);
+        REQUIRE(id >= 0);
+        m.remove_handler(id);
+    }
+
+    running = false;
+    sampling.join();
+
+    // The permanent handler was called for every sample
+    REQUIRE(count >= processed);
+    REQUIRE(m.get_handler_count() == 1);
+    REQUIRE(m.get_handler_id(0) == permanent);
+}
+
+#endif
+
+/* Handler period tests */
+namespace {
+    class counting_sensor : public ipass::test::mock_sensor {
+    public:
+        int reads = 0;
+
+        ipass::vector3<int16_t> get_gyro() override {
+            reads++;
+            return mock_sensor::get_gyro();
+        }
+    };
+}
+
+TEST_CASE("ipass::motion_sensor evaluates handlers at their period") {
+    counting_sensor m;
+
+    static int fast;
+    static int slow;
+    fast = 0;
+    slow = 0;
+
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+
+    const auto every = m.when(tilted, [](const auto &, const auto &) { fast++; });
+    const auto limited = m.when(tilted, [](const auto &, const auto &) { slow++; });
+
+    m.set_period(limited, 100);
+    m.set_gyro({200, 0, 0});
+
+    for (uint_fast64_t t = 0; t < 1000; t += 10) {
+        m.set_timestamp(t);
+        m.process_handlers();
+    }
+
+    REQUIRE(fast == 100);
+    REQUIRE(slow == 10);
+    REQUIRE(m.reads == 100);
+    REQUIRE(m.get_overruns(limited) == 0);
+
+    // With only slow handlers, the sensor is only read when one is due
+    m.remove_handler(every);
+    m.reads = 0;
+
+    for (uint_fast64_t t = 1000; t < 2000; t += 10) {
+        m.set_timestamp(t);
+        m.process_handlers();
+    }
+
+    REQUIRE(slow == 20);
+    REQUIRE(m.reads == 10);
+
+    // Missing a whole period is an overrun, after which the schedule restarts
+    m.set_timestamp(2350);
+    m.process_handlers();
+    REQUIRE(slow == 21);
+    REQUIRE(m.get_overruns(limited) == 1);
+
+    m.set_timestamp(2400);
+    m.process_handlers();
+    REQUIRE(slow == 21);
+
+    m.set_timestamp(2450);
+    m.process_handlers();
+    REQUIRE(slow == 22);
+    REQUIRE(m.get_overruns(limited) == 1);
+    REQUIRE(m.get_overruns(-1) == 0);
+}
+
+TEST_CASE("ipass::motion_sensor applies periods to blocks of samples") {
+    int16_t gyro_x[64];
+    int16_t zero[64] = {};
+
+    for (int i = 0; i < 64; i++) {
+        gyro_x[i] = int16_t(i % 3 == 0 ? 0 : 200);
+    }
+
+    const ipass::sample_block block = {
+        {gyro_x, zero, zero},
+        {zero, zero, zero},
+        64, 0, 10, nullptr
+    };
+
+    static int block_calls;
+    static int sample_calls;
+    static int *calls;
+
+    ipass::gyro_rule tilted = {ipass::motion::x_greater_then, 100};
+
+    auto register_handlers = [&](ipass::motion_sensor &m) {
+        const auto id = m.when(tilted, [](const auto &, const auto &) { (*calls)++; });
+        m.set_period(id, 25);
+    };
+
+    block_calls = 0;
+    sample_calls = 0;
+
+    ipass::test::mock_sensor batch;
+    register_handlers(batch);
+    calls = &block_calls;
+    batch.process_handlers(block);
+
+    ipass::test::mock_sensor single;
+    register_handlers(single);
+    calls = &sample_calls;
+
+    for (uint16_t i = 0; i < block.count; i++) {
+        single.set_gyro(block.get_gyro(i));
+        single.set_timestamp(block.get_timestamp(i));
+        single.process_handlers();
+    }
+
+    REQUIRE(block_calls == sample_calls);
+    REQUIRE(block_calls > 0);
+    REQUIRE(block_calls < 32);
+}
+
+/* MPU6050 tests */
+namespace {
+    void put_vector(uint8_t *data, const ipass::vector3<int16_t> &v) {
+        const int16_t values[3] = {v.x, v.y, v.z};
+
+        for (int i = 0; i < 3; i++) {
+            data[i * 2] = uint8_t(uint16_t(values[i]) >> 8);
+            data[i * 2 + 1] = uint8_t(values[i]);
+        }
+    }
+
+    void setup_fifo(ipass::test::mock_i2c_bus &bus) {
+        bus.set_fifo(0x74, 0x72, 0x6A, 0x04, 0x40);
+        bus.set_clear_on_read(0x3A);
+    }
+}
+
+TEST_CASE("mpu6050 reads a sample in one burst") {
+    ipass::test::mock_i2c_bus bus;
+    mpu6050 sensor(bus);
+
+    uint8_t registers[14];
+    put_vector(registers, {0, -16384, 16384});
+    registers[6] = 0x01;
+    registers[7] = 0x02;
+    put_vector(registers + 8, {262, -131, 0});
+
+    for (uint8_t i = 0; i < 14; i++) {
+        bus.set_register(uint8_t(0x3B + i), registers[i]);
+    }
+
+    const auto sample = sensor.get_sample();
+
+    REQUIRE(bus.get_transactions() == 2);
+    REQUIRE(bus.get_last_address() == 0x68);
+    REQUIRE(sample.accel == ipass::vector3<int16_t>(0, -2048, 2048));
+    REQUIRE(sample.gyro == ipass::vector3<int16_t>(32, -16, 0));
+    REQUIRE(sample.temperature == 0x0102);
+}
+
+TEST_CASE("mpu6050 stores handlers without a decorator") {
+    ipass::test::mock_i2c_bus bus;
+    mpu6050 sensor(bus);
+
+    uint8_t registers[14] = {};
+    put_vector(registers + 8, {262, 0, 0});
+
+    for (uint8_t i = 0; i < 14; i++) {
+        bus.set_register(uint8_t(0x3B + i), registers[i]);
+    }
+
+    static int count;
+    count = 0;
+
+    ipass::gyro_rule turning = {ipass::motion::x_greater_then, ipass::gyro_format::from_int(1)};
+    REQUIRE(sensor.when(turning, [](const auto &, const auto &) { count++; }) >= 0);
+
+    sensor.process_handlers();
+    REQUIRE(count == 1);
+}
+
+TEST_CASE("mpu6050 applies its configuration") {
+    constexpr mpu6050_config fast = {
+        mpu6050_gyro_range::dps_2000, mpu6050_accel_range::g_16, mpu6050_dlpf::hz_260, 7
+    };
+
+    constexpr mpu6050_config filtered = {
+        mpu6050_gyro_range::dps_500, mpu6050_accel_range::g_4, mpu6050_dlpf::hz_44, 4
+    };
+
+    static_assert(mpu6050_config().get_accel_scale() == 16384, "2 g");
+    static_assert(mpu6050_config().get_gyro_scale() == 1310, "250 dps");
+    static_assert(fast.get_accel_scale() == 2048, "16 g");
+    static_assert(fast.get_gyro_scale() == 164, "2000 dps");
+    static_assert(fast.get_sample_interval() == 1000, "1 kHz");
+    static_assert(filtered.get_sample_interval() == 5000, "200 Hz");
+
+    ipass::test::mock_i2c_bus bus;
+
+    for (uint8_t i = 0x19; i <= 0x1C; i++) {
+        bus.set_register(i, 0xFF);
+    }
+
+    SECTION("the default keeps the most sensitive ranges") {
+        mpu6050 sensor(bus);
+        sensor.initialize();
+
+        REQUIRE(bus.get_register(0x6B) == 0);
+        REQUIRE(bus.get_register(0x19) == 0);
+        REQUIRE(bus.get_register(0x1A) == 0);
+        REQUIRE(bus.get_register(0x1B) == 0);
+        REQUIRE(bus.get_register(0x1C) == 0);
+    }
+
+    SECTION("all registers are written in one transaction") {
+        mpu6050 sensor(bus, filtered);
+
+        const auto before = bus.get_transactions();
+        sensor.initialize();
+
+        // Power management and the four adjacent config registers
+        REQUIRE(bus.get_transactions() - before == 2);
+        REQUIRE(bus.get_register(0x19) == 4);
+        REQUIRE(bus.get_register(0x1A) == 3);
+        REQUIRE(bus.get_register(0x1B) == 0x08);
+        REQUIRE(bus.get_register(0x1C) == 0x08);
+    }
+
+    SECTION("samples are scaled to the range") {
+        mpu6050 sensor(bus, fast);
+        sensor.initialize();
+
+        REQUIRE(bus.get_register(0x1B) == 0x18);
+        REQUIRE(bus.get_register(0x1C) == 0x18);
+
+        uint8_t registers[14] = {};
+        put_vector(registers, {2048 * 3, -2048 * 8, 2048});
+        put_vector(registers + 8, {164 * 10, -82 * 10, 1640 * 10});
+
+        for (uint8_t i = 0; i < 14; i++) {
+            bus.set_register(uint8_t(0x3B + i), registers[i]);
+        }
+
+        const auto sample = sensor.get_sample();
+
+        REQUIRE(sample.accel == ipass::vector3<int16_t>(3 * 2048, -8 * 2048, 2048));
+        REQUIRE(sample.gyro == ipass::vector3<int16_t>(100 * 16, -50 * 16, 1000 * 16));
+        REQUIRE(sensor.get_accel() == sample.accel);
+        REQUIRE(sensor.get_gyro() == sample.gyro);
+    }
+}
+
+TEST_CASE("mpu6050 keeps the resolution of the sensor") {
+    static_assert(mpu6050_config().get_accel_shift() == 3, "2 g");
+    static_assert(mpu6050_config().get_gyro_multiplier() == 8004, "250 dps");
+
+    ipass::test::mock_i2c_bus bus;
+    mpu6050 sensor(bus);
+
+    uint8_t registers[14] = {};
+    put_vector(registers, {8192, -4915, 16384 + 1638});
+    put_vector(registers + 8, {131 * 3 / 2, -13, 0});
+
+    for (uint8_t i = 0; i < 14; i++) {
+        bus.set_register(uint8_t(0x3B + i), registers[i]);
+    }
+
+    const auto sample = sensor.get_sample();
+
+    // 0.5 g, -0.3 g and 1.1 g
+    REQUIRE(sample.accel == ipass::vector3<int16_t>(1024, -615, 2252));
+
+    // 1.5 and -0.1 degrees per second
+    REQUIRE(sample.gyro == ipass::vector3<int16_t>(24, -2, 0));
+}
+
+TEST_CASE("mpu6050 streams samples through the FIFO") {
+    ipass::test::mock_i2c_bus bus;
+    setup_fifo(bus);
+
+    mpu6050_config config;
+    config.sample_divider = 7;
+
+    mpu6050 sensor(bus, config);
+    sensor.initialize();
+    sensor.start_fifo();
+
+    REQUIRE(bus.get_register(0x19) == 7);
+    REQUIRE(bus.get_register(0x23) == 0x78);
+    REQUIRE(bus.get_register(0x6A) == 0x40);
+
+    uint8_t frame[12];
+
+    SECTION("whole frames are read with their timestamps") {
+        put_vector(frame, {0, 0, 16384});
+        put_vector(frame + 6, {131 * 10, 0, 0});
+
+        for (int i = 0; i < 3; i++) {
+            bus.push_fifo(frame, 12);
+        }
+
+        // Half a frame stays in the FIFO
+        bus.push_fifo(frame, 5);
+
+        ipass::motion_sample samples[8];
+        REQUIRE(sensor.read_fifo(samples, 8) == 3);
+        REQUIRE(bus.get_fifo_size() == 5);
+
+        REQUIRE(samples[0].gyro == ipass::vector3<int16_t>(10 * 16, 0, 0));
+        REQUIRE(samples[2].accel == ipass::vector3<int16_t>(0, 0, 2048));
+        REQUIRE(samples[1].timestamp - samples[0].timestamp == 1000);
+        REQUIRE(samples[2].timestamp - samples[1].timestamp == 1000);
+    }
+
+    SECTION("the FIFO is drained into the handlers") {
+        static int count;
+        count = 0;
+
+        ipass::gyro_rule tilted = {ipass::motion::x_greater_then, ipass::gyro_format::from_int(100)};
+        sensor.when(tilted, [](const auto &, const auto &) { count++; });
+
+        for (int i = 0; i < 40; i++) {
+            put_vector(frame, {0, 0, 16384});
+            put_vector(frame + 6, {int16_t(i % 2 == 0 ? 0 : 131 * 200), 0, 0});
+            bus.push_fifo(frame, 12);
+        }
+
+        const auto before = bus.get_transactions();
+
+        REQUIRE(sensor.process_samples() == 40);
+        REQUIRE(count == 20);
+        REQUIRE(bus.get_fifo_size() == 0);
+
+        // Far less than a transaction per sample
+        REQUIRE(bus.get_transactions() - before < 20);
+    }
+
+    SECTION("a decorator drains the FIFO with its correction") {
+        static int count;
+        count = 0;
+
+        ipass::gyro_corrected_motion_sensor corrected(sensor, {ipass::gyro_format::from_int(50), 0, 0});
+
+        ipass::gyro_rule tilted = {ipass::motion::x_greater_then, ipass::gyro_format::from_int(100)};
+        REQUIRE(corrected.when(tilted, [](const auto &, const auto &) { count++; }) >= 0);
+
+        // 120 degrees per second, 70 after the correction
+        put_vector(frame, {0, 0, 16384});
+        put_vector(frame + 6, {131 * 120, 0, 0});
+
+        for (int i = 0; i < 20; i++) {
+            bus.push_fifo(frame, 12);
+        }
+
+        REQUIRE(corrected.process_samples() == 20);
+        REQUIRE(count == 0);
+
+        // 160 degrees per second, 110 after the correction
+        put_vector(frame + 6, {131 * 160, 0, 0});
+
+        for (int i = 0; i < 20; i++) {
+            bus.push_fifo(frame, 12);
+        }
+
+        REQUIRE(corrected.process_samples() == 20);
+        REQUIRE(count == 20);
+        REQUIRE(bus.get_fifo_size() == 0);
+    }
+
+    SECTION("an overflow is reported and resets the FIFO") {
+        put_vector(frame, {0, 0, 0});
+        put_vector(frame + 6, {0, 0, 0});
+
+        bool kept = true;
+
+        for (int i = 0; i < 100; i++) {
+            kept = bus.push_fifo(frame, 12) && kept;
+        }
+
+        REQUIRE_FALSE(kept);
+        bus.set_register(0x3A, 0x10);
+
+        ipass::motion_sample samples[8];
+        REQUIRE(sensor.read_fifo(samples, 8) == 0);
+        REQUIRE(sensor.get_overflows() == 1);
+        REQUIRE(bus.get_fifo_size() == 0);
+        REQUIRE(bus.get_register(0x3A) == 0);
+
+        bus.push_fifo(frame, 12);
+        REQUIRE(sensor.read_fifo(samples, 8) == 1);
+        REQUIRE(sensor.get_overflows() == 1);
+    }
+}
+
+TEST_CASE("mpu6050 programs the motion interrupt") {
+    ipass::test::mock_i2c_bus bus;
+
+    mpu6050_config config;
+    config.accel_range = mpu6050_accel_range::g_4;
+
+    mpu6050 sensor(bus, config);
+    sensor.initialize();
+
+    sensor.set_motion_detection(20, 5);
+
+    REQUIRE(bus.get_register(0x1C) == 0x09);
+    REQUIRE(bus.get_register(0x1F) == 20);
+    REQUIRE(bus.get_register(0x20) == 5);
+
+    sensor.enable_interrupts(mpu6050::INTERRUPT_MOTION | mpu6050::INTERRUPT_DATA_READY);
+
+    REQUIRE(bus.get_register(0x37) == 0x20);
+    REQUIRE(bus.get_register(0x38) == 0x41);
+
+    sensor.enable_interrupts(0);
+    REQUIRE(bus.get_register(0x38) == 0);
+}
+
+TEST_CASE("mpu6050 processes the handlers on its interrupt") {
+    static int count;
+    count = 0;
+
+    ipass::test::mock_i2c_bus bus;
+    bus.set_clear_on_read(0x3A);
+
+    ipass::test::mock_pin_in pin;
+    pin.follow(bus, 0x3A);
+
+    uint8_t registers[14] = {};
+    put_vector(registers, {0, 0, 16384});
+
+    for (uint8_t i = 0; i < 14; i++) {
+        bus.set_register(uint8_t(0x3B + i), registers[i]);
+    }
+
+    mpu6050 mpu(bus);
+    mpu.initialize();
+    mpu.enable_interrupts(mpu6050::INTERRUPT_MOTION);
+
+    ipass::gyro_corrected_motion_sensor sensor(mpu, {});
+
+    ipass::accel_rule flat = {ipass::motion::z_greater_then, ipass::accel_format::from_ratio(9, 10)};
+    sensor.when(flat, [](const auto &, const auto &) { count++; });
+
+    sensor.use_interrupt(&pin);
+
+    SECTION("the bus is idle without an interrupt") {
+        const auto before = bus.get_transactions();
+
+        for (int i = 0; i < 10; i++) {
+            sensor.process_handlers();
+        }
+
+        REQUIRE(count == 0);
+        REQUIRE(pin.get_reads() == 10);
+        REQUIRE(bus.get_transactions() == before);
+    }
+
+    SECTION("an interrupt is acknowledged and processed once") {
+        bus.set_register(0x3A, 0x40);
+
+        const auto before = bus.get_transactions();
+
+        sensor.process_handlers();
+        sensor.process_handlers();
+
+        REQUIRE(count == 1);
+        REQUIRE(bus.get_register(0x3A) == 0);
+
+        // The status and the sample, a write and a read each
+        REQUIRE(bus.get_transactions() - before == 4);
+    }
+
+    SECTION("sources that are not enabled are ignored") {
+        bus.set_register(0x3A, 0x01);
+
+        sensor.process_handlers();
+
+        REQUIRE(count == 0);
+        REQUIRE(bus.get_register(0x3A) == 0);
+    }
+
+    SECTION("a FIFO overflow is kept for read_fifo") {
+        bus.set_fifo(0x74, 0x72, 0x6A, 0x04, 0x40);
+        mpu.start_fifo();
+
+        bus.set_register(0x3A, 0x50);
+        sensor.process_handlers();
+
+        REQUIRE(count == 1);
+
+        ipass::motion_sample samples[8];
+        REQUIRE(mpu.read_fifo(samples, 8) == 0);
+        REQUIRE(mpu.get_overflows() == 1);
+    }
+
+    SECTION("an interrupt cleared by draining the FIFO is not lost") {
+        setup_fifo(bus);
+        mpu.start_fifo();
+
+        uint8_t frame[12] = {};
+        put_vector(frame, {0, 0, 16384});
+
+        for (int i = 0; i < 4; i++) {
+            bus.push_fifo(frame, 12);
+        }
+
+        bus.set_register(0x3A, 0x40);
+
+        ipass::motion_sample samples[8];
+        REQUIRE(mpu.read_fifo(samples, 8) == 4);
+        REQUIRE_FALSE(pin.get());
+        REQUIRE(mpu.has_pending_interrupt());
+
+        sensor.process_handlers();
+        REQUIRE(count == 1);
+        REQUIRE_FALSE(mpu.has_pending_interrupt());
+
+        sensor.process_handlers();
+        REQUIRE(count == 1);
+    }
+
+    SECTION("polling again without the pin") {
+        sensor.use_interrupt(nullptr);
+        sensor.process_handlers();
+
+        REQUIRE(count == 1);
+        REQUIRE(pin.get_reads() == 0);
+    }
+}
@@ -0,0 +1,132 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "mock_i2c_bus.hpp"
+
+ipass::test::mock_i2c_bus::mock_i2c_bus()
+        : registers(), pointer(0), last_address(0), transactions(0), fifo(), fifo_head(0), fifo_size(0),
+          fifo_register(0), count_register(0), reset_register(0), reset_bit(0), enable_bit(0), clear_register(0),
+          has_fifo(false) {}
+
+void ipass::test::mock_i2c_bus::update_count() {
+    if (has_fifo) {
+        registers[count_register] = uint8_t(fifo_size >> 8);
+        registers[uint8_t(count_register + 1)] = uint8_t(fifo_size);
+    }
+}
+
+void ipass::test::mock_i2c_bus::write(uint_fast8_t address, const uint8_t data[], size_t n) {
+    last_address = uint8_t(address);
+    transactions++;
+
+    if (n == 0) {
+        return;
+    }
+
+    pointer = data[0];
+
+    for (size_t i = 1; i < n; i++) {
+        registers[pointer] = data[i];
+
+        if (has_fifo && pointer == reset_register && (data[i] & reset_bit)) {
+            // The reset bit clears itself, but only resets a disabled FIFO
+            if (!(data[i] & enable_bit)) {
+                fifo_size = 0;
+                update_count();
+            }
+
+            registers[pointer] &= uint8_t(~reset_bit);
+        }
+
+        pointer++;
+    }
+}
+
+void ipass::test::mock_i2c_bus::read(uint_fast8_t address, uint8_t data[], size_t n) {
+    last_address = uint8_t(address);
+    transactions++;
+
+    for (size_t i = 0; i < n; i++) {
+        if (has_fifo && pointer == fifo_register) {
+            // The FIFO register does not advance the pointer
+            if (fifo_size == 0) {
+                data[i] = 0;
+                continue;
+            }
+
+            data[i] = fifo[fifo_head];
+            fifo_head = uint16_t((fifo_head + 1) % fifo_capacity);
+            fifo_size--;
+            update_count();
+            continue;
+        }
+
+        data[i] = registers[pointer];
+
+        if (clear_register != 0 && pointer == clear_register) {
+            registers[pointer] = 0;
+        }
+
+        pointer++;
+    }
+}
+
+uint8_t ipass::test::mock_i2c_bus::get_register(uint8_t reg) const {
+    return registers[reg];
+}
+
+void ipass::test::mock_i2c_bus::set_register(uint8_t reg, uint8_t value) {
+    registers[reg] = value;
+}
+
+void ipass::test::mock_i2c_bus::set_fifo(uint8_t data_register, uint8_t count_register, uint8_t reset_register,
+                                         uint8_t reset_bit, uint8_t enable_bit) {
+    this->fifo_register = data_register;
+    this->count_register = count_register;
+    this->reset_register = reset_register;
+    this->reset_bit = reset_bit;
+    this->enable_bit = enable_bit;
+
+    has_fifo = true;
+    update_count();
+}
+
+bool ipass::test::mock_i2c_bus::push_fifo(const uint8_t *data, uint16_t size) {
+    bool kept = true;
+
+    for (uint16_t i = 0; i < size; i++) {
+        if (fifo_size == fifo_capacity) {
+            fifo_head = uint16_t((fifo_head + 1) % fifo_capacity);
+            fifo_size--;
+            kept = false;
+        }
+
+        fifo[(fifo_head + fifo_size) % fifo_capacity] = data[i];
+        fifo_size++;
+    }
+
+    update_count();
+    return kept;
+}
+
+uint16_t ipass::test::mock_i2c_bus::get_fifo_size() const {
+    return fifo_size;
+}
+
+void ipass::test::mock_i2c_bus::set_clear_on_read(uint8_t reg) {
+    clear_register = reg;
+}
+
+uint32_t ipass::test::mock_i2c_bus::get_transactions() const {
+    return transactions;
+}
+
+uint8_t ipass::test::mock_i2c_bus::get_last_address() const {
+    return last_address;
+}
@@ -0,0 +1,110 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_MOCK_I2C_BUS_HPP
+#define IPASS_MOCK_I2C_BUS_HPP
+
+#include <cstdint>
+#include "hwlib.hpp"
+
+namespace ipass::test {
+    /**
+     * \brief
+     * I2C bus with a single register mapped device behind it.
+     * \details
+     * The first byte of a write sets the register pointer, the other
+     * bytes are written to consecutive registers. A read starts at the
+     * register pointer and advances it, except for the FIFO data
+     * register, which pops bytes from the FIFO.
+     */
+    class mock_i2c_bus : public hwlib::i2c_bus {
+    public:
+        constexpr static uint16_t fifo_capacity = 1024;
+
+    private:
+        uint8_t registers[256];
+        uint8_t pointer;
+        uint8_t last_address;
+        uint32_t transactions;
+
+        uint8_t fifo[fifo_capacity];
+        uint16_t fifo_head;
+        uint16_t fifo_size;
+
+        uint8_t fifo_register;
+        uint8_t count_register;
+        uint8_t reset_register;
+        uint8_t reset_bit;
+        uint8_t enable_bit;
+        uint8_t clear_register;
+        bool has_fifo;
+
+        void update_count();
+
+    public:
+        mock_i2c_bus();
+
+        void write(uint_fast8_t address, const uint8_t data[], size_t n) override;
+
+        void read(uint_fast8_t address, uint8_t data[], size_t n) override;
+
+        uint8_t get_register(uint8_t reg) const;
+
+        void set_register(uint8_t reg, uint8_t value);
+
+        /**
+         * \brief
+         * Set up the FIFO.
+         * \details
+         * The count is stored big endian in count_register and the register
+         * after it. Writing reset_bit to reset_register empties the FIFO,
+         * unless enable_bit is written along with it: like the real chip,
+         * only a disabled FIFO can be reset.
+         * @param data_register
+         * @param count_register
+         * @param reset_register
+         * @param reset_bit
+         * @param enable_bit
+         */
+        void set_fifo(uint8_t data_register, uint8_t count_register, uint8_t reset_register, uint8_t reset_bit,
+                      uint8_t enable_bit = 0);
+
+        /**
+         * \brief
+         * Add bytes to the FIFO.
+         * \details
+         * When the FIFO is full the oldest bytes are dropped,
+         * and false is returned.
+         * @param data
+         * @param size
+         * @return
+         */
+        bool push_fifo(const uint8_t *data, uint16_t size);
+
+        uint16_t get_fifo_size() const;
+
+        /**
+         * \brief
+         * Clear the given register after it is read, like an interrupt status.
+         * @param reg
+         */
+        void set_clear_on_read(uint8_t reg);
+
+        /**
+         * \brief
+         * The amount of reads and writes on the bus.
+         * @return
+         */
+        uint32_t get_transactions() const;
+
+        uint8_t get_last_address() const;
+    };
+}
+
+#endif //IPASS_MOCK_I2C_BUS_HPP
@@ -0,0 +1,37 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "mock_pin_in.hpp"
+
+ipass::test::mock_pin_in::mock_pin_in()
+        : level(false), bus(nullptr), status_register(0), reads(0) {}
+
+bool ipass::test::mock_pin_in::get(hwlib::buffering) {
+    reads++;
+
+    if (bus != nullptr) {
+        return bus->get_register(status_register) != 0;
+    }
+
+    return level;
+}
+
+void ipass::test::mock_pin_in::set(bool value) {
+    level = value;
+    bus = nullptr;
+}
+
+void ipass::test::mock_pin_in::follow(const ipass::test::mock_i2c_bus &source, uint8_t reg) {
+    bus = &source;
+    status_register = reg;
+}
+
+uint32_t ipass::test::mock_pin_in::get_reads() const {
+    return reads;
+}
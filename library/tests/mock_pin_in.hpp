@@ -0,0 +1,62 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_MOCK_PIN_IN_HPP
+#define IPASS_MOCK_PIN_IN_HPP
+
+#include <cstdint>
+#include "hwlib.hpp"
+#include "mock_i2c_bus.hpp"
+
+namespace ipass::test {
+    /**
+     * \brief
+     * Input pin that is set by the test, like an interrupt line.
+     * \details
+     * The level is either set directly, or follows a register of a
+     * mock_i2c_bus: the pin is high while the register is not 0, so a
+     * latched interrupt stays high until its status is read.
+     */
+    class mock_pin_in : public hwlib::pin_in {
+    private:
+        bool level;
+        const mock_i2c_bus *bus;
+        uint8_t status_register;
+        uint32_t reads;
+
+    public:
+        mock_pin_in();
+
+        bool get(hwlib::buffering buf = hwlib::buffering::unbuffered) override;
+
+        /**
+         * \brief
+         * Set the level of the pin, and stop following a register.
+         * @param value
+         */
+        void set(bool value);
+
+        /**
+         * \brief
+         * Be high while the given register of the bus is not 0.
+         * @param source
+         * @param reg
+         */
+        void follow(const mock_i2c_bus &source, uint8_t reg);
+
+        /**
+         * \brief
+         * The amount of times the pin was read.
+         * @return
+         */
+        uint32_t get_reads() const;
+    };
+}
+
+#endif //IPASS_MOCK_PIN_IN_HPP
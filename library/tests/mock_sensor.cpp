@@ -9,10 +9,11 @@
 
 #include "mock_sensor.hpp"
 
-ipass::test::mock_sensor::mock_sensor() : gyro(), accel() {}
+ipass::test::mock_sensor::mock_sensor()
+        : motion_sensor(handlers), handlers(), gyro(), accel(), timestamp(0) {}
 
 ipass::test::mock_sensor::mock_sensor(ipass::vector3<int16_t> &gyro, ipass::vector3<int16_t> &accel)
-        : gyro(gyro), accel(accel) {}
+        : motion_sensor(handlers), handlers(), gyro(gyro), accel(accel), timestamp(0) {}
 
 ipass::vector3<int16_t> ipass::test::mock_sensor::get_gyro() {
     return gyro;
@@ -22,10 +23,18 @@ ipass::vector3<int16_t> ipass::test::mock_sensor::get_accel() {
     return accel;
 }
 
+uint_fast64_t ipass::test::mock_sensor::get_timestamp() {
+    return timestamp;
+}
+
 void ipass::test::mock_sensor::set_gyro(const vector3<int16_t> &gyro) {
     this->gyro = gyro;
 }
 
 void ipass::test::mock_sensor::set_accel(const vector3<int16_t> &accel) {
     this->accel = accel;
+}
+
+void ipass::test::mock_sensor::set_timestamp(uint_fast64_t timestamp) {
+    this->timestamp = timestamp;
 }
\ No newline at end of file
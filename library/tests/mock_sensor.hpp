@@ -15,7 +15,9 @@
 namespace ipass::test {
     class mock_sensor : public motion_sensor {
     private:
+        fixed_handler_snapshot<default_handler_count> handlers;
         vector3<int16_t> gyro, accel;
+        uint_fast64_t timestamp;
 
     public:
         mock_sensor();
@@ -28,9 +30,13 @@ namespace ipass::test {
 
         vector3<int16_t> get_accel() override;
 
+        uint_fast64_t get_timestamp() override;
+
         void set_gyro(const vector3<int16_t> &gyro);
 
         void set_accel(const vector3<int16_t> &accel);
+
+        void set_timestamp(uint_fast64_t timestamp);
     };
 }
 
@@ -0,0 +1,132 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "threshold_index.hpp"
+#include "leaf_table.hpp"
+
+ipass::threshold_index::threshold_index()
+        : entries(), offsets(), greater_below(), less_above() {}
+
+void ipass::threshold_index::build(const ipass::rule_leaf *leaves, uint8_t count) {
+    uint8_t size = 0;
+    offsets[0] = 0;
+
+    for (uint8_t list = 0; list < list_count; list++) {
+        const auto source = rule_source(list / 3);
+        const uint8_t axis = list % 3;
+        const uint8_t start = size;
+
+        for (uint8_t i = 0; i < count; i++) {
+            const auto &leaf = leaves[i];
+
+            if (leaf.source != source || leaf.axis != axis
+                || leaf.opcode < rule_opcode::greater_then || leaf.opcode > rule_opcode::less_then) {
+                continue;
+            }
+
+            // Find the entry for the threshold, keeping the list sorted
+            uint8_t position = start;
+
+            while (position < size && entries[position].threshold < leaf.threshold) {
+                position++;
+            }
+
+            if (position == size || entries[position].threshold != leaf.threshold) {
+                for (uint8_t j = size; j > position; j--) {
+                    entries[j] = entries[j - 1];
+                }
+
+                entries[position] = {leaf.threshold, no_leaf, no_leaf, no_leaf};
+                size++;
+            }
+
+            switch (leaf.opcode) {
+                case rule_opcode::greater_then:
+                    entries[position].greater = i;
+                    break;
+
+                case rule_opcode::equal_to:
+                    entries[position].equal = i;
+                    break;
+
+                default:
+                    entries[position].less = i;
+                    break;
+            }
+        }
+
+        offsets[list + 1] = size;
+
+        const uint8_t length = size - start;
+        const uint8_t base = start + list;
+
+        greater_below[base].clear();
+
+        for (uint8_t i = 0; i < length; i++) {
+            greater_below[base + i + 1] = greater_below[base + i];
+
+            if (entries[start + i].greater != no_leaf) {
+                greater_below[base + i + 1].set(entries[start + i].greater);
+            }
+        }
+
+        less_above[base + length].clear();
+
+        for (uint8_t i = length; i > 0; i--) {
+            less_above[base + i - 1] = less_above[base + i];
+
+            if (entries[start + i - 1].less != no_leaf) {
+                less_above[base + i - 1].set(entries[start + i - 1].less);
+            }
+        }
+    }
+}
+
+ipass::leaf_mask ipass::threshold_index::evaluate(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    const int16_t *sources[] = {gyro.data, accel.data};
+    leaf_mask result;
+
+    for (uint8_t list = 0; list < list_count; list++) {
+        const uint8_t start = offsets[list];
+        const uint8_t end = offsets[list + 1];
+
+        if (start == end) {
+            continue;
+        }
+
+        const int16_t value = sources[list / 3][list % 3];
+
+        // Find the first threshold that is not below the value
+        uint8_t low = start;
+        uint8_t high = end;
+
+        while (low < high) {
+            const uint8_t middle = (low + high) / 2;
+
+            if (entries[middle].threshold < value) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+
+        const uint8_t base = start + list;
+        const uint8_t below = low - start;
+        const bool equal = low < end && entries[low].threshold == value;
+
+        result |= greater_below[base + below];
+        result |= less_above[base + below + equal];
+
+        if (equal && entries[low].equal != no_leaf) {
+            result.set(entries[low].equal);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,100 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_THRESHOLD_INDEX_HPP
+#define IPASS_THRESHOLD_INDEX_HPP
+
+#include <cstdint>
+#include "vector3.hpp"
+#include "leaf_mask.hpp"
+
+namespace ipass {
+
+    struct rule_leaf;
+
+    /**
+     * \brief
+     * Sorted index over the threshold leaves of a leaf table.
+     * \details
+     * For every source and axis the thresholds of all greater, equal and
+     * less leaves are kept in one sorted list. A sample value splits such
+     * a list in the thresholds below and above it: the greater leaves below
+     * it and the less leaves above it all match. Those sets are stored as
+     * precomputed prefix and suffix masks, so a single binary search per
+     * axis yields every matching leaf of that axis.
+     */
+    class threshold_index {
+    private:
+        /**
+         * \brief
+         * The amount of lists, one per source and axis.
+         */
+        constexpr static uint8_t list_count = 6;
+
+        /**
+         * \brief
+         * Marks that no leaf exists for a comparison.
+         */
+        constexpr static uint8_t no_leaf = 0xFF;
+
+        /**
+         * \brief
+         * A distinct threshold of a list, with the leaf
+         * of every comparison using that threshold.
+         */
+        struct entry {
+            int16_t threshold;
+            uint8_t greater;
+            uint8_t equal;
+            uint8_t less;
+        };
+
+        entry entries[leaf_mask::capacity];
+        uint8_t offsets[list_count + 1];
+
+        /*
+         * Both mask arrays have one more item per list than the list
+         * has entries, position i of a list starts at offsets[list] + list.
+         */
+        leaf_mask greater_below[leaf_mask::capacity + list_count];
+        leaf_mask less_above[leaf_mask::capacity + list_count];
+
+    public:
+        /**
+         * \brief
+         * 0 argument constructor.
+         * \details
+         * Construct an empty index, which matches no leaves.
+         */
+        threshold_index();
+
+        /**
+         * \brief
+         * Build the index from the given leaves.
+         * \details
+         * Only greater, equal and less leaves are indexed,
+         * other leaves are skipped. Leaf i of the array is
+         * bit i in the results.
+         * @param leaves
+         * @param count
+         */
+        void build(const rule_leaf *leaves, uint8_t count);
+
+        /**
+         * \brief
+         * Get all indexed leaves that match the given data.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        leaf_mask evaluate(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const;
+    };
+}
+
+#endif //IPASS_THRESHOLD_INDEX_HPP
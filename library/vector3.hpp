@@ -43,7 +43,7 @@ namespace ipass {
          * @param y
          * @param z
          */
-        vector3(T x, T y, T z)
+        constexpr vector3(T x, T y, T z)
                 : x(x), y(y), z(z) {}
 
         /**
@@ -52,7 +52,7 @@ namespace ipass {
          * \details
          * Construct the vector with all values initialized to 0.
          */
-        vector3() : x(0), y(0), z(0) {}
+        constexpr vector3() : x(0), y(0), z(0) {}
 
         /* Generic operations */
 
@@ -302,6 +302,60 @@ namespace ipass {
             return *this;
         }
 
+        /* Shifts */
+
+        /**
+         * \brief
+         * Shift the values of this vector right, yielding a new vector.
+         * \details
+         * For fixed point values this divides by a power of 2.
+         * @param rhs
+         * @return
+         */
+        vector3 operator>>(const int rhs) const {
+            return vector3{T(x >> rhs), T(y >> rhs), T(z >> rhs)};
+        }
+
+        /**
+         * \brief
+         * Shift the values of this vector right in-place.
+         * @param rhs
+         * @return
+         */
+        vector3 &operator>>=(const int rhs) {
+            x = T(x >> rhs);
+            y = T(y >> rhs);
+            z = T(z >> rhs);
+
+            return *this;
+        }
+
+        /**
+         * \brief
+         * Shift the values of this vector left, yielding a new vector.
+         * \details
+         * For fixed point values this multiplies by a power of 2.
+         * @param rhs
+         * @return
+         */
+        vector3 operator<<(const int rhs) const {
+            return vector3{T(x * (1 << rhs)), T(y * (1 << rhs)), T(z * (1 << rhs))};
+        }
+
+        /**
+         * \brief
+         * Shift the values of this vector left in-place.
+         * @param rhs
+         * @return
+         */
+        vector3 &operator<<=(const int rhs) {
+            x = T(x * (1 << rhs));
+            y = T(y * (1 << rhs));
+            z = T(z * (1 << rhs));
+
+            return *this;
+        }
+
         /* Equality */
 
         /**
@@ -0,0 +1,131 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "vector_rule.hpp"
+
+namespace {
+    /*
+     * The squared length of a vector of int16_t is at most 3 * 2^30,
+     * which still fits an unsigned 32 bit integer.
+     */
+    uint32_t length_squared(const ipass::vector3<int16_t> &v) {
+        return uint32_t(int32_t(v.x) * v.x)
+               + uint32_t(int32_t(v.y) * v.y)
+               + uint32_t(int32_t(v.z) * v.z);
+    }
+
+    int64_t dot(const ipass::vector3<int16_t> &lhs, const ipass::vector3<int16_t> &rhs) {
+        return int64_t(int32_t(lhs.x) * rhs.x)
+               + int64_t(int32_t(lhs.y) * rhs.y)
+               + int64_t(int32_t(lhs.z) * rhs.z);
+    }
+
+    uint32_t square_root(uint32_t value) {
+        uint32_t result = 0;
+        uint32_t bit = uint32_t(1) << 30;
+
+        while (bit > value) {
+            bit >>= 2;
+        }
+
+        while (bit != 0) {
+            if (value >= result + bit) {
+                value -= result + bit;
+                result = (result >> 1) + bit;
+            } else {
+                result >>= 1;
+            }
+
+            bit >>= 2;
+        }
+
+        return result;
+    }
+
+    template<typename T>
+    bool compare_values(const T lhs, const T rhs, const ipass::comparison how) {
+        switch (how) {
+            case ipass::comparison::greater_then:
+                return lhs > rhs;
+
+            case ipass::comparison::equal_to:
+                return lhs == rhs;
+
+            case ipass::comparison::less_then:
+                return lhs < rhs;
+        }
+
+        return false;
+    }
+}
+
+ipass::vector_rule::vector_rule(ipass::rule_source source)
+        : motion_rule(motion::none, 0), source(source) {}
+
+const ipass::vector3<int16_t> &ipass::vector_rule::select(const vector3<int16_t> &gyro,
+                                                          const vector3<int16_t> &accel) const {
+    return source == rule_source::gyro ? gyro : accel;
+}
+
+ipass::magnitude_rule::magnitude_rule(ipass::rule_source source, ipass::comparison compare, uint16_t magnitude)
+        : vector_rule(source), compare(compare), squared(uint32_t(magnitude) * magnitude) {}
+
+bool ipass::magnitude_rule::match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    return compare_values(length_squared(select(gyro, accel)), squared, compare);
+}
+
+ipass::dot_rule::dot_rule(ipass::rule_source source, const ipass::vector3<int16_t> &direction,
+                          ipass::comparison compare, int32_t threshold)
+        : vector_rule(source), direction(direction), compare(compare), threshold(threshold) {}
+
+bool ipass::dot_rule::match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    return compare_values(dot(select(gyro, accel), direction), int64_t(threshold), compare);
+}
+
+ipass::cone_rule::cone_rule(ipass::rule_source source, const ipass::vector3<int16_t> &axis, int16_t cosine)
+        : vector_rule(source), axis(), cosine(cosine), factor(0) {
+    const uint32_t length = square_root(length_squared(axis));
+
+    if (length == 0) {
+        return;
+    }
+
+    // Scale the axis to a length of 256, rounded to the nearest integer
+    const int32_t half = int32_t(length / 2);
+
+    const int16_t given[3] = {axis.x, axis.y, axis.z};
+
+    for (uint8_t i = 0; i < 3; i++) {
+        const int32_t scaled = int32_t(given[i]) * 256;
+        this->axis[i] = int16_t((scaled + (scaled < 0 ? -half : half)) / int32_t(length));
+    }
+
+    // |axis|^2 * cos^2, with the Q30 of the squared cosine shifted out
+    factor = uint32_t((uint64_t(length_squared(this->axis)) * uint64_t(int32_t(cosine) * cosine)) >> 30);
+}
+
+bool ipass::cone_rule::match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const {
+    const vector3<int16_t> &data = select(gyro, accel);
+    const uint32_t squared = length_squared(data);
+
+    if (squared == 0 || axis == vector3<int16_t>()) {
+        return false;
+    }
+
+    const int64_t projection = dot(data, axis);
+    const uint64_t projection_squared = uint64_t(projection * projection);
+    const uint64_t bound = uint64_t(squared) * factor;
+
+    if (cosine >= 0) {
+        return projection >= 0 && projection_squared >= bound;
+    }
+
+    // A half angle above 90 degrees: anything not too far behind the axis
+    return projection >= 0 || projection_squared <= bound;
+}
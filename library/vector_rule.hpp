@@ -0,0 +1,181 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_VECTOR_RULE_HPP
+#define IPASS_VECTOR_RULE_HPP
+
+#include <cstdint>
+#include "vector3.hpp"
+#include "motion_rule.hpp"
+#include "rule_program.hpp"
+
+namespace ipass {
+
+    /**
+     * \brief
+     * Comparison of a vector quantity against a threshold.
+     */
+    enum class comparison : uint8_t {
+        greater_then,
+        equal_to,
+        less_then
+    };
+
+    /**
+     * \brief
+     * Base class for a rule on a whole vector instead of a single axis.
+     * \details
+     * Vector rules only use integer arithmetic: instead of taking square
+     * roots, squared quantities are compared. They are as cheap as a few
+     * axis rules and need no floating point unit.
+     *
+     * When registered on a sensor, a vector rule is evaluated as a
+     * call leaf: once per sample, shared by all handlers using it.
+     */
+    class vector_rule : public motion_rule {
+    protected:
+        rule_source source;
+
+        /**
+         * \brief
+         * Constructor with the source of the vector.
+         * @param source
+         */
+        explicit vector_rule(rule_source source);
+
+        /**
+         * \brief
+         * Select the vector of the source from the given data.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        const vector3<int16_t> &select(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const;
+    };
+
+    /**
+     * \brief
+     * Rule on the length of a vector.
+     * \details
+     * The squared length of the vector is compared against
+     * the squared magnitude, so no square root is needed.
+     *
+     * \code
+     * // Total acceleration above 2 g
+     * ipass::magnitude_rule shaken(ipass::rule_source::accel, ipass::comparison::greater_then,
+     *                              ipass::accel_format::from_int(2));
+     * \endcode
+     */
+    class magnitude_rule : public vector_rule {
+    private:
+        comparison compare;
+        uint32_t squared;
+
+    public:
+        /**
+         * \brief
+         * Constructor with the source, comparison and magnitude.
+         * @param source
+         * @param compare
+         * @param magnitude
+         */
+        magnitude_rule(rule_source source, comparison compare, uint16_t magnitude);
+
+        /**
+         * \brief
+         * Will compare the length of the vector against the magnitude.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const override;
+    };
+
+    /**
+     * \brief
+     * Rule on the dot product of a vector with a fixed direction.
+     * \details
+     * The dot product is calculated in 64 bits, so it can't overflow.
+     * With a unit direction scaled to a power of two the threshold is
+     * the projection of the vector on that direction.
+     */
+    class dot_rule : public vector_rule {
+    private:
+        vector3<int16_t> direction;
+        comparison compare;
+        int32_t threshold;
+
+    public:
+        /**
+         * \brief
+         * Constructor with the source, direction, comparison and threshold.
+         * @param source
+         * @param direction
+         * @param compare
+         * @param threshold
+         */
+        dot_rule(rule_source source, const vector3<int16_t> &direction, comparison compare, int32_t threshold);
+
+        /**
+         * \brief
+         * Will compare the dot product with the direction against the threshold.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const override;
+    };
+
+    /**
+     * \brief
+     * Rule that matches if a vector points within a cone.
+     * \details
+     * The cone is given by its axis and the cosine of its half angle,
+     * as a Q15 fixed point value (32767 is a cosine of 1). A vector
+     * matches if the angle with the axis is at most the half angle,
+     * which is tested as dot(v, axis)^2 >= |v|^2 * |axis|^2 * cos^2
+     * with the sign of the dot product checked separately.
+     *
+     * The axis is scaled to a length of 256 on construction, which keeps
+     * all products within 64 bits and the angle accurate to about 0.2
+     * degrees. A zero vector or axis has no direction and never matches.
+     *
+     * \code
+     * // Gravity within 20 degrees of +Z, cos(20) * 32768 = 30792
+     * ipass::cone_rule flat(ipass::rule_source::accel, {0, 0, 1}, 30792);
+     * \endcode
+     */
+    class cone_rule : public vector_rule {
+    private:
+        vector3<int16_t> axis;
+        int16_t cosine;
+        uint32_t factor;
+
+    public:
+        /**
+         * \brief
+         * Constructor with the source, cone axis and Q15 cosine of the half angle.
+         * @param source
+         * @param axis
+         * @param cosine
+         */
+        cone_rule(rule_source source, const vector3<int16_t> &axis, int16_t cosine);
+
+        /**
+         * \brief
+         * Will match if the vector lies within the cone.
+         * @param gyro
+         * @param accel
+         * @return
+         */
+        bool match_against(const vector3<int16_t> &gyro, const vector3<int16_t> &accel) const override;
+    };
+}
+
+#endif //IPASS_VECTOR_RULE_HPP
@@ -0,0 +1,104 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#include "worker_pool.hpp"
+
+#if defined(__linux__)
+
+ipass::worker_pool::worker_pool(ipass::event_queue &queue)
+        : queue(queue), workers(), worker_count(0), running(false), handled_count(0), lock(), wake() {}
+
+ipass::worker_pool::~worker_pool() {
+    stop();
+}
+
+void ipass::worker_pool::work() {
+    motion_event event;
+
+    for (;;) {
+        while (queue.pop(event)) {
+            event.call();
+            handled_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (!running.load(std::memory_order_acquire)) {
+            // Handle anything pushed just before stopping
+            if (queue.depth() == 0) {
+                return;
+            }
+
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard, [this] {
+            return queue.depth() != 0 || !running.load(std::memory_order_acquire);
+        });
+    }
+}
+
+bool ipass::worker_pool::start(uint8_t count) {
+    if (worker_count != 0 || count == 0 || count > max_workers) {
+        return false;
+    }
+
+    running.store(true, std::memory_order_release);
+
+    for (uint8_t i = 0; i < count; i++) {
+        workers[i] = std::thread(&worker_pool::work, this);
+    }
+
+    worker_count = count;
+    return true;
+}
+
+void ipass::worker_pool::stop() {
+    if (worker_count == 0) {
+        return;
+    }
+
+    running.store(false, std::memory_order_release);
+
+    {
+        // A worker that just found the queue empty is waiting before this returns
+        std::lock_guard<std::mutex> guard(lock);
+    }
+
+    wake.notify_all();
+
+    for (uint8_t i = 0; i < worker_count; i++) {
+        workers[i].join();
+    }
+
+    worker_count = 0;
+}
+
+bool ipass::worker_pool::dispatch(const ipass::motion_event &event) {
+    if (!queue.push(event)) {
+        return false;
+    }
+
+    {
+        // A worker that just found the queue empty is waiting before this returns
+        std::lock_guard<std::mutex> guard(lock);
+    }
+
+    wake.notify_one();
+    return true;
+}
+
+uint32_t ipass::worker_pool::handled() const {
+    return handled_count.load(std::memory_order_relaxed);
+}
+
+uint8_t ipass::worker_pool::get_worker_count() const {
+    return worker_count;
+}
+
+#endif //defined(__linux__)
@@ -0,0 +1,128 @@
+// ==========================================================================
+// Copyright (c) Lex Ruesink (lex.ruesink@student.hu.nl) 2018
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//
+// ==========================================================================
+
+#ifndef IPASS_WORKER_POOL_HPP
+#define IPASS_WORKER_POOL_HPP
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "event_queue.hpp"
+
+namespace ipass {
+
+    /**
+     * \brief
+     * Threads that run the handler calls from an event_queue.
+     * \details
+     * Only available on Linux hosts. The pool is a motion_dispatcher:
+     * events are pushed onto the queue and a sleeping worker is woken up,
+     * so the sensor thread only pays for the push and a short lock. Idle
+     * workers sleep until there is an event.
+     *
+     * With more than one worker, handlers run concurrently and events
+     * of different samples may be handled out of order. Handlers that
+     * share state have to synchronize themselves.
+     *
+     * \code
+     * ipass::fixed_event_queue<64> queue;
+     * ipass::worker_pool pool(queue);
+     *
+     * pool.start(2);
+     * sensor.set_dispatcher(&pool);
+     * \endcode
+     */
+    class worker_pool : public motion_dispatcher {
+    public:
+        /**
+         * \brief
+         * The maximum amount of workers.
+         */
+        constexpr static uint8_t max_workers = 8;
+
+    private:
+        event_queue &queue;
+        std::thread workers[max_workers];
+        uint8_t worker_count;
+
+        std::atomic<bool> running;
+        std::atomic<uint32_t> handled_count;
+        std::mutex lock;
+        std::condition_variable wake;
+
+        void work();
+
+    public:
+        /**
+         * \brief
+         * Constructor with the queue to drain.
+         * @param queue
+         */
+        explicit worker_pool(event_queue &queue);
+
+        worker_pool(const worker_pool &) = delete;
+
+        worker_pool &operator=(const worker_pool &) = delete;
+
+        /**
+         * \brief
+         * Stops the workers.
+         */
+        ~worker_pool();
+
+        /**
+         * \brief
+         * Start the given amount of workers.
+         * \details
+         * Returns false if the pool is already running or the
+         * count is not between 1 and max_workers.
+         * @param count
+         * @return
+         */
+        bool start(uint8_t count);
+
+        /**
+         * \brief
+         * Stop and join the workers.
+         * \details
+         * Events still in the queue are handled before the workers stop.
+         */
+        void stop();
+
+        /**
+         * \brief
+         * Push the event onto the queue and wake up a worker.
+         * @param event
+         * @return
+         */
+        bool dispatch(const motion_event &event) override;
+
+        /**
+         * \brief
+         * The amount of events handled by the workers.
+         * @return
+         */
+        uint32_t handled() const;
+
+        /**
+         * \brief
+         * The amount of running workers.
+         * @return
+         */
+        uint8_t get_worker_count() const;
+    };
+}
+
+#endif //defined(__linux__)
+
+#endif //IPASS_WORKER_POOL_HPP